@@ -0,0 +1,645 @@
+#pragma once
+#include "memory.hpp"
+#include "profiler.hpp"
+#include "scheduler.hpp"
+
+// Scratch memory for acceleration structure builds. Buffers are
+// sub-allocated, so the device address is aligned by hand.
+struct ScratchBuffer {
+	Buffer buffer;
+	vk::DeviceAddress address = 0;
+	vk::DeviceSize size = 0;
+
+	void init(MemoryAllocator& allocator, vk::Device device, vk::DeviceSize size) {
+		vk::DeviceSize alignment = vkutils::getAccelStructProps(
+			allocator.getPhysicalDevice()).minAccelerationStructureScratchOffsetAlignment;
+
+		buffer.init(allocator, device, size + alignment,
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+		address = vkutils::alignUp(static_cast<vk::DeviceSize>(buffer.address), alignment);
+		this->size = size;
+	}
+};
+
+// Geometry of one bottom level structure
+struct BlasInput {
+	std::vector<vk::AccelerationStructureGeometryKHR> geometries;
+	std::vector<vk::AccelerationStructureBuildRangeInfoKHR> rangeInfos;
+	vk::BuildAccelerationStructureFlagsKHR flags =
+		vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
+
+	// Copy into a right-sized buffer after the build
+	bool compact = false;
+};
+
+struct AccelStruct {
+	vk::UniqueAccelerationStructureKHR accel;
+	Buffer buffer;
+	vk::DeviceSize size = 0;  // of the structure; the allocation may be larger
+
+	// State of structures that are updated after creation (initUpdatable)
+	ScratchBuffer scratchBuffer;
+	uint32_t refitCount = 0;
+	uint32_t maxRefits = 0;
+	bool built = false;
+
+	// Creates the structure and its storage without building it
+	void create(MemoryAllocator& allocator, vk::Device device,
+		vk::AccelerationStructureTypeKHR type,
+		vk::DeviceSize size) {
+		buffer.init(allocator, device, size,
+			vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+		vk::AccelerationStructureCreateInfoKHR createInfo{};
+		createInfo.setBuffer(*buffer.buffer);
+		createInfo.setOffset(0);
+		createInfo.setSize(size);
+		createInfo.setType(type);
+		accel = device.createAccelerationStructureKHRUnique(createInfo);
+		this->size = size;
+	}
+
+	void updateAddress(vk::Device device) {
+		vk::AccelerationStructureDeviceAddressInfoKHR addressInfo{};
+		addressInfo.setAccelerationStructure(*accel);
+		buffer.address = device.getAccelerationStructureAddressKHR(addressInfo);
+	}
+
+	// Creates a BLAS for deforming geometry. It keeps a scratch buffer large
+	// enough for both builds and refits so update() never allocates. Every
+	// maxRefits refits a full rebuild restores trace quality; 0 disables
+	// refitting. The first update() always builds.
+	void initUpdatable(MemoryAllocator& allocator, vk::Device device,
+		const BlasInput& input, uint32_t maxRefits) {
+		vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{};
+		buildInfo.setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
+		buildInfo.setFlags(input.flags | vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate);
+		buildInfo.setGeometries(input.geometries);
+
+		std::vector<uint32_t> maxPrimitiveCounts;
+		for (const auto& rangeInfo : input.rangeInfos) {
+			maxPrimitiveCounts.push_back(rangeInfo.primitiveCount);
+		}
+
+		vk::AccelerationStructureBuildSizesInfoKHR buildSizes =
+			device.getAccelerationStructureBuildSizesKHR(
+				vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, maxPrimitiveCounts);
+
+		create(allocator, device, vk::AccelerationStructureTypeKHR::eBottomLevel,
+			buildSizes.accelerationStructureSize);
+		updateAddress(device);
+		scratchBuffer.init(allocator, device,
+			std::max(buildSizes.buildScratchSize, buildSizes.updateScratchSize));
+
+		this->maxRefits = maxRefits;
+		refitCount = 0;
+		built = false;
+	}
+
+	// Records a refit in place, or a full rebuild when the refit budget is
+	// spent. input must have the same geometry layout and primitive counts
+	// as the one given to initUpdatable; only the vertex data may change.
+	// TLASes referencing this BLAS must be rebuilt or refit afterwards.
+	void update(vk::CommandBuffer commandBuffer, const BlasInput& input) {
+		bool refit = built && refitCount < maxRefits;
+
+		vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{};
+		buildInfo.setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
+		buildInfo.setFlags(input.flags | vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate);
+		buildInfo.setGeometries(input.geometries);
+		buildInfo.setMode(refit
+			? vk::BuildAccelerationStructureModeKHR::eUpdate
+			: vk::BuildAccelerationStructureModeKHR::eBuild);
+		buildInfo.setSrcAccelerationStructure(refit ? *accel : vk::AccelerationStructureKHR{});
+		buildInfo.setDstAccelerationStructure(*accel);
+		buildInfo.setScratchData(scratchBuffer.address);
+
+		// Earlier TLAS builds and traces may still read this structure
+		vk::MemoryBarrier beforeBuild{};
+		beforeBuild.setSrcAccessMask(
+			vk::AccessFlagBits::eAccelerationStructureReadKHR |
+			vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+		beforeBuild.setDstAccessMask(
+			vk::AccessFlagBits::eAccelerationStructureReadKHR |
+			vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eRayTracingShaderKHR |
+			vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+			vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+			{}, beforeBuild, {}, {});
+
+		commandBuffer.buildAccelerationStructuresKHR(buildInfo, input.rangeInfos.data());
+
+		vk::MemoryBarrier afterBuild{};
+		afterBuild.setSrcAccessMask(vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+		afterBuild.setDstAccessMask(vk::AccessFlagBits::eAccelerationStructureReadKHR);
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+			vk::PipelineStageFlagBits::eRayTracingShaderKHR |
+			vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+			{}, afterBuild, {}, {});
+
+		refitCount = refit ? refitCount + 1 : 0;
+		built = true;
+	}
+};
+
+// Structure sizes: the build size and the compacted-size query result
+struct CompactionResult {
+	size_t index = 0;
+	vk::DeviceSize originalSize = 0;
+	vk::DeviceSize compactedSize = 0;
+};
+
+// Replaces each listed structure by a compacted copy. compactedSizes come
+// from an eAccelerationStructureCompactedSizeKHR query written after the
+// build; the originals are freed once the copies have completed.
+// Without `ticket` this waits for the copies, otherwise the copies are
+// complete when the returned ticket is.
+inline std::vector<CompactionResult> compactAccelStructs(
+	MemoryAllocator& allocator, vk::Device device,
+	GpuScheduler& scheduler,
+	std::vector<AccelStruct>& accels,
+	const std::vector<size_t>& indices,
+	const std::vector<vk::DeviceSize>& compactedSizes,
+	GpuTicket* ticket = nullptr) {
+
+	std::vector<AccelStruct> compacted(indices.size());
+	std::vector<CompactionResult> results(indices.size());
+	for (size_t i = 0; i < indices.size(); i++) {
+		compacted[i].create(allocator, device,
+			vk::AccelerationStructureTypeKHR::eBottomLevel, compactedSizes[i]);
+
+		results[i].index = indices[i];
+		results[i].originalSize = accels[indices[i]].size;
+		results[i].compactedSize = compactedSizes[i];
+	}
+
+	GpuTicket copied = scheduler.submit(
+		[&](vk::CommandBuffer commandBuffer) {
+			for (size_t i = 0; i < indices.size(); i++) {
+				vk::CopyAccelerationStructureInfoKHR copyInfo{};
+				copyInfo.setSrc(*accels[indices[i]].accel);
+				copyInfo.setDst(*compacted[i].accel);
+				copyInfo.setMode(vk::CopyAccelerationStructureModeKHR::eCompact);
+				commandBuffer.copyAccelerationStructureKHR(copyInfo);
+			}
+		});
+
+	// The originals are read by the copies until the ticket completes
+	auto originals = std::make_shared<std::vector<AccelStruct>>(indices.size());
+	vk::DeviceSize totalOriginal = 0;
+	vk::DeviceSize totalCompacted = 0;
+	for (size_t i = 0; i < indices.size(); i++) {
+		(*originals)[i] = std::move(accels[indices[i]]);
+		accels[indices[i]] = std::move(compacted[i]);
+		accels[indices[i]].updateAddress(device);
+		totalOriginal += results[i].originalSize;
+		totalCompacted += results[i].compactedSize;
+	}
+
+	std::cout << "Compact " << indices.size() << " BLAS: "
+		<< totalOriginal / 1024 << " KiB -> " << totalCompacted / 1024 << " KiB\n";
+
+	if (ticket) {
+		*ticket = copied;
+		scheduler.then(copied, [originals]() {});
+	}
+	else {
+		scheduler.wait(copied);
+	}
+	return results;
+}
+
+// Builds many BLASes with one submission. Inputs are split into chunks whose
+// total scratch size fits in scratchBudget; chunks share one scratch buffer
+// and are separated by a barrier, so scratch memory stays bounded while
+// submit and fence overhead is paid once for the whole batch.
+// Inputs marked compact are compacted afterwards, which needs one more
+// submission; the bytes saved per BLAS are appended to compactionResults.
+// With a profiler the builds are timed as the "BLAS build" scope in the
+// second immediate slot, collected once the builds have completed.
+// The build waits for `waits`, e.g. the upload of its geometry on another
+// queue. Without `ticket` the structures are ready for any queue once this
+// returns; otherwise they are when the returned ticket is, which lets the
+// caller wait on the GPU instead. Compaction reads the compacted sizes
+// back, so it still blocks until the builds themselves have finished.
+inline std::vector<AccelStruct> buildBottomLevelAccelStructs(
+	MemoryAllocator& allocator, vk::Device device,
+	GpuScheduler& scheduler,
+	const std::vector<BlasInput>& inputs,
+	vk::DeviceSize scratchBudget = 256ull << 20,
+	std::vector<CompactionResult>* compactionResults = nullptr,
+	GpuProfiler* profiler = nullptr,
+	const std::vector<vkutils::TimelineWait>& waits = {},
+	GpuTicket* ticket = nullptr) {
+
+	std::vector<AccelStruct> accels(inputs.size());
+	if (inputs.empty()) {
+		return accels;
+	}
+
+	vk::DeviceSize scratchAlignment = vkutils::getAccelStructProps(
+		allocator.getPhysicalDevice()).minAccelerationStructureScratchOffsetAlignment;
+
+	std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> buildInfos(inputs.size());
+	std::vector<vk::DeviceSize> scratchOffsets(inputs.size());
+
+	// [begin, end) ranges of inputs built together
+	std::vector<std::pair<size_t, size_t>> chunks;
+	vk::DeviceSize chunkScratchSize = 0;
+	vk::DeviceSize maxChunkScratchSize = 0;
+	size_t chunkBegin = 0;
+
+	for (size_t i = 0; i < inputs.size(); i++) {
+		const BlasInput& input = inputs[i];
+
+		buildInfos[i].setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
+		buildInfos[i].setMode(vk::BuildAccelerationStructureModeKHR::eBuild);
+		buildInfos[i].setFlags(input.compact
+			? input.flags | vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction
+			: input.flags);
+		buildInfos[i].setGeometries(input.geometries);
+
+		std::vector<uint32_t> maxPrimitiveCounts;
+		for (const auto& rangeInfo : input.rangeInfos) {
+			maxPrimitiveCounts.push_back(rangeInfo.primitiveCount);
+		}
+
+		vk::AccelerationStructureBuildSizesInfoKHR buildSizes =
+			device.getAccelerationStructureBuildSizesKHR(
+				vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfos[i], maxPrimitiveCounts);
+
+		accels[i].create(allocator, device,
+			vk::AccelerationStructureTypeKHR::eBottomLevel,
+			buildSizes.accelerationStructureSize);
+		buildInfos[i].setDstAccelerationStructure(*accels[i].accel);
+
+		vk::DeviceSize scratchSize = vkutils::alignUp(buildSizes.buildScratchSize, scratchAlignment);
+		if (i > chunkBegin && chunkScratchSize + scratchSize > scratchBudget) {
+			chunks.emplace_back(chunkBegin, i);
+			chunkBegin = i;
+			chunkScratchSize = 0;
+		}
+		scratchOffsets[i] = chunkScratchSize;
+		chunkScratchSize += scratchSize;
+		maxChunkScratchSize = std::max(maxChunkScratchSize, chunkScratchSize);
+	}
+	chunks.emplace_back(chunkBegin, inputs.size());
+
+	// Freed by the scheduler once the builds have completed
+	auto scratchBuffer = std::make_shared<ScratchBuffer>();
+	scratchBuffer->init(allocator, device, maxChunkScratchSize);
+	for (size_t i = 0; i < inputs.size(); i++) {
+		buildInfos[i].setScratchData(scratchBuffer->address + scratchOffsets[i]);
+	}
+
+	std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> rangeInfoPtrs;
+	for (const auto& input : inputs) {
+		rangeInfoPtrs.push_back(input.rangeInfos.data());
+	}
+
+	std::vector<size_t> compactIndices;
+	std::vector<vk::AccelerationStructureKHR> compactAccels;
+	for (size_t i = 0; i < inputs.size(); i++) {
+		if (inputs[i].compact) {
+			compactIndices.push_back(i);
+			compactAccels.push_back(*accels[i].accel);
+		}
+	}
+
+	vk::UniqueQueryPool queryPool;
+	if (!compactIndices.empty()) {
+		vk::QueryPoolCreateInfo queryPoolCreateInfo{};
+		queryPoolCreateInfo.setQueryType(vk::QueryType::eAccelerationStructureCompactedSizeKHR);
+		queryPoolCreateInfo.setQueryCount(static_cast<uint32_t>(compactIndices.size()));
+		queryPool = device.createQueryPoolUnique(queryPoolCreateInfo);
+	}
+
+	std::cout << "Build " << inputs.size() << " BLAS in "
+		<< chunks.size() << " chunks (scratch " << maxChunkScratchSize / 1024 << " KiB)\n";
+
+	GpuTicket built = scheduler.submit(
+		[&](vk::CommandBuffer commandBuffer) {
+			if (profiler) {
+				profiler->beginFrame(commandBuffer, profiler->getImmediateSlot(1));
+				profiler->beginScope(commandBuffer, "BLAS build");
+			}
+
+			for (size_t c = 0; c < chunks.size(); c++) {
+				auto [begin, end] = chunks[c];
+
+				// The previous chunk must finish before its scratch is reused
+				if (c > 0) {
+					vk::MemoryBarrier barrier{};
+					barrier.setSrcAccessMask(vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+					barrier.setDstAccessMask(
+						vk::AccessFlagBits::eAccelerationStructureReadKHR |
+						vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+					commandBuffer.pipelineBarrier(
+						vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+						vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+						{}, barrier, {}, {});
+				}
+
+				commandBuffer.buildAccelerationStructuresKHR(
+					static_cast<uint32_t>(end - begin),
+					buildInfos.data() + begin,
+					rangeInfoPtrs.data() + begin);
+			}
+
+			if (profiler) {
+				profiler->endScope(commandBuffer);
+			}
+
+			if (queryPool) {
+				uint32_t queryCount = static_cast<uint32_t>(compactAccels.size());
+				commandBuffer.resetQueryPool(*queryPool, 0, queryCount);
+
+				vk::MemoryBarrier barrier{};
+				barrier.setSrcAccessMask(vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+				barrier.setDstAccessMask(vk::AccessFlagBits::eAccelerationStructureReadKHR);
+				commandBuffer.pipelineBarrier(
+					vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+					vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+					{}, barrier, {}, {});
+
+				commandBuffer.writeAccelerationStructuresPropertiesKHR(
+					compactAccels,
+					vk::QueryType::eAccelerationStructureCompactedSizeKHR,
+					*queryPool, 0);
+			}
+		}, waits);
+	scheduler.then(built, [scratchBuffer, profiler]() {
+		if (profiler) {
+			profiler->collect(profiler->getImmediateSlot(1));
+		}
+	});
+
+	if (queryPool || !ticket) {
+		scheduler.wait(built);
+	}
+
+	if (queryPool) {
+		uint32_t queryCount = static_cast<uint32_t>(compactAccels.size());
+		auto compactedSizes = device.getQueryPoolResults<vk::DeviceSize>(
+			*queryPool, 0, queryCount,
+			queryCount * sizeof(vk::DeviceSize), sizeof(vk::DeviceSize),
+			vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+		if (compactedSizes.result != vk::Result::eSuccess) {
+			std::cerr << "Failed to get compacted sizes.\n";
+			std::abort();
+		}
+
+		auto results = compactAccelStructs(allocator, device, scheduler,
+			accels, compactIndices, compactedSizes.value, ticket ? &built : nullptr);
+		if (compactionResults) {
+			compactionResults->insert(compactionResults->end(), results.begin(), results.end());
+		}
+	}
+
+	for (auto& accel : accels) {
+		accel.updateAddress(device);
+	}
+	if (ticket) {
+		*ticket = built;
+	}
+	return accels;
+}
+
+// Top level structure whose instances can change every frame. Instances live
+// in host memory and are copied into a persistently mapped buffer owned by the
+// current frame in flight, so the host never writes data the GPU is reading.
+// Transform changes are applied with a refit (eUpdate); adding or removing
+// instances triggers a full rebuild. Removed slots are masked out and reused.
+class DynamicTopLevelAS {
+public:
+	using InstanceId = uint32_t;
+
+	void init(MemoryAllocator& allocator, vk::Device device,
+		uint32_t frameCount, uint32_t capacity = 1024) {
+		this->allocator = &allocator;
+		this->device = device;
+		instanceBuffers.resize(frameCount);
+		reserve(std::max(capacity, 1u));
+	}
+
+	InstanceId addInstance(const vk::AccelerationStructureInstanceKHR& instance) {
+		InstanceId id;
+		if (!freeSlots.empty()) {
+			id = freeSlots.back();
+			freeSlots.pop_back();
+			instances[id] = instance;
+		}
+		else {
+			id = static_cast<InstanceId>(instances.size());
+			instances.push_back(instance);
+		}
+		needsRebuild = true;
+		return id;
+	}
+
+	void removeInstance(InstanceId id) {
+		instances[id].setMask(0);
+		instances[id].setAccelerationStructureReference(0);
+		freeSlots.push_back(id);
+		needsRebuild = true;
+	}
+
+	void setTransform(InstanceId id, const vk::TransformMatrixKHR& transform) {
+		instances[id].setTransform(transform);
+		needsUpdate = true;
+	}
+
+	// Refits next frame, e.g. after a referenced BLAS was updated in place
+	void requestUpdate() {
+		needsUpdate = true;
+	}
+
+	uint32_t getInstanceCount() const {
+		return static_cast<uint32_t>(instances.size() - freeSlots.size());
+	}
+
+	vk::AccelerationStructureKHR get() const { return *accel.accel; }
+	vk::DeviceAddress getAddress() const { return accel.buffer.address; }
+
+	// True between prepare() and record() when this frame changes the TLAS
+	bool isBuildPending() const { return pendingBuild; }
+
+	// Host side part of the frame: grows the structure if needed and uploads
+	// the instances. Returns true when the acceleration structure handle
+	// changed and descriptors referring to it must be rewritten.
+	bool prepare(uint32_t frameIndex) {
+		frameCounter++;
+		releaseRetired();
+
+		bool handleChanged = false;
+		if (instances.size() > capacity) {
+			reserve(std::max(capacity * 2, static_cast<uint32_t>(instances.size())));
+			handleChanged = true;
+		}
+
+		pendingBuild = needsRebuild || needsUpdate;
+		if (!pendingBuild) {
+			return handleChanged;
+		}
+
+		Buffer& instanceBuffer = instanceBuffers[frameIndex];
+		memcpy(instanceBuffer.allocation.mapped(), instances.data(),
+			instances.size() * sizeof(vk::AccelerationStructureInstanceKHR));
+		currentInstanceBuffer = &instanceBuffer;
+		return handleChanged;
+	}
+
+	// Records the rebuild or refit prepared for this frame followed by a
+	// barrier that makes it visible to ray tracing shaders.
+	void record(vk::CommandBuffer commandBuffer) {
+		if (!pendingBuild) {
+			return;
+		}
+		pendingBuild = false;
+
+		bool update = !needsRebuild && builtInstanceCount == instances.size();
+
+		vk::AccelerationStructureGeometryInstancesDataKHR instancesData{};
+		instancesData.setArrayOfPointers(false);
+		instancesData.setData(currentInstanceBuffer->address);
+
+		vk::AccelerationStructureGeometryKHR geometry{};
+		geometry.setGeometryType(vk::GeometryTypeKHR::eInstances);
+		geometry.setGeometry({ instancesData });
+		geometry.setFlags(vk::GeometryFlagBitsKHR::eOpaque);
+
+		vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{};
+		buildInfo.setType(vk::AccelerationStructureTypeKHR::eTopLevel);
+		buildInfo.setFlags(buildFlags);
+		buildInfo.setGeometries(geometry);
+		buildInfo.setMode(update
+			? vk::BuildAccelerationStructureModeKHR::eUpdate
+			: vk::BuildAccelerationStructureModeKHR::eBuild);
+		buildInfo.setSrcAccelerationStructure(update ? *accel.accel : vk::AccelerationStructureKHR{});
+		buildInfo.setDstAccelerationStructure(*accel.accel);
+		buildInfo.setScratchData(scratchBuffer.address);
+
+		vk::AccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
+		buildRangeInfo.setPrimitiveCount(static_cast<uint32_t>(instances.size()));
+
+		// The previous frame may still be tracing against this structure
+		vk::MemoryBarrier beforeBuild{};
+		beforeBuild.setSrcAccessMask(
+			vk::AccessFlagBits::eAccelerationStructureReadKHR |
+			vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+		beforeBuild.setDstAccessMask(
+			vk::AccessFlagBits::eAccelerationStructureReadKHR |
+			vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eRayTracingShaderKHR |
+			vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+			vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+			{}, beforeBuild, {}, {});
+
+		commandBuffer.buildAccelerationStructuresKHR(buildInfo, &buildRangeInfo);
+
+		vk::MemoryBarrier afterBuild{};
+		afterBuild.setSrcAccessMask(vk::AccessFlagBits::eAccelerationStructureWriteKHR);
+		afterBuild.setDstAccessMask(vk::AccessFlagBits::eAccelerationStructureReadKHR);
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+			vk::PipelineStageFlagBits::eRayTracingShaderKHR |
+			vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+			{}, afterBuild, {}, {});
+
+		builtInstanceCount = static_cast<uint32_t>(instances.size());
+		needsRebuild = false;
+		needsUpdate = false;
+	}
+
+private:
+	static constexpr vk::BuildAccelerationStructureFlagsKHR buildFlags =
+		vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace |
+		vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate;
+
+	// Resources replaced on growth, kept until no frame can reference them
+	struct Retired {
+		AccelStruct accel;
+		ScratchBuffer scratchBuffer;
+		std::vector<Buffer> instanceBuffers;
+		uint64_t releaseFrame = 0;
+	};
+
+	MemoryAllocator* allocator = nullptr;
+	vk::Device device;
+
+	std::vector<vk::AccelerationStructureInstanceKHR> instances;
+	std::vector<InstanceId> freeSlots;
+	uint32_t capacity = 0;
+	uint32_t builtInstanceCount = 0;
+	bool needsRebuild = true;
+	bool needsUpdate = false;
+	bool pendingBuild = false;
+
+	AccelStruct accel;
+	ScratchBuffer scratchBuffer;
+	std::vector<Buffer> instanceBuffers;
+	Buffer* currentInstanceBuffer = nullptr;
+
+	uint64_t frameCounter = 0;
+	std::vector<Retired> retired;
+
+	// Sizes the structure, scratch and instance buffers for newCapacity instances
+	void reserve(uint32_t newCapacity) {
+		if (accel.accel) {
+			Retired old{};
+			old.accel = std::move(accel);
+			old.scratchBuffer = std::move(scratchBuffer);
+			old.instanceBuffers = std::move(instanceBuffers);
+			old.releaseFrame = frameCounter + old.instanceBuffers.size();
+			instanceBuffers.resize(old.instanceBuffers.size());
+			retired.push_back(std::move(old));
+		}
+		capacity = newCapacity;
+
+		vk::AccelerationStructureGeometryInstancesDataKHR instancesData{};
+		instancesData.setArrayOfPointers(false);
+
+		vk::AccelerationStructureGeometryKHR geometry{};
+		geometry.setGeometryType(vk::GeometryTypeKHR::eInstances);
+		geometry.setGeometry({ instancesData });
+		geometry.setFlags(vk::GeometryFlagBitsKHR::eOpaque);
+
+		vk::AccelerationStructureBuildGeometryInfoKHR buildInfo{};
+		buildInfo.setType(vk::AccelerationStructureTypeKHR::eTopLevel);
+		buildInfo.setFlags(buildFlags);
+		buildInfo.setGeometries(geometry);
+
+		vk::AccelerationStructureBuildSizesInfoKHR buildSizes =
+			device.getAccelerationStructureBuildSizesKHR(
+				vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, capacity);
+
+		accel.create(*allocator, device, vk::AccelerationStructureTypeKHR::eTopLevel,
+			buildSizes.accelerationStructureSize);
+		accel.updateAddress(device);
+		scratchBuffer.init(*allocator, device,
+			std::max(buildSizes.buildScratchSize, buildSizes.updateScratchSize));
+
+		for (auto& instanceBuffer : instanceBuffers) {
+			instanceBuffer.init(*allocator, device,
+				capacity * sizeof(vk::AccelerationStructureInstanceKHR),
+				vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
+				vk::BufferUsageFlagBits::eShaderDeviceAddress,
+				vk::MemoryPropertyFlagBits::eHostVisible |
+				vk::MemoryPropertyFlagBits::eHostCoherent);
+		}
+
+		builtInstanceCount = 0;
+		needsRebuild = true;
+	}
+
+	void releaseRetired() {
+		std::erase_if(retired, [&](const Retired& r) {
+			return r.releaseFrame <= frameCounter;
+		});
+	}
+};
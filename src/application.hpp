@@ -0,0 +1,1684 @@
+#pragma once
+#include "config.h"
+#include "vkutils.hpp"
+#include "accel.hpp"
+#include "mesh.hpp"
+#include "staging.hpp"
+#include "profiler.hpp"
+#include "camera.hpp"
+#include "sbt.hpp"
+#include "hotreload.hpp"
+#include "recorder.hpp"
+#include "scheduler.hpp"
+#include "startup.hpp"
+#include <array>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <glm/gtc/type_ptr.hpp>
+#include <imgui.h>
+#include <backends/imgui_impl_glfw.h>
+#include <backends/imgui_impl_vulkan.h>
+
+constexpr uint32_t width = 800;
+constexpr uint32_t height = 600;
+
+struct AppOptions {
+	uint32_t framesInFlight = 2;
+	bool validation = true;
+	bool compactAccel = false;
+
+	// Render without a window into an offscreen image and write it to disk
+	bool headless = false;
+	uint32_t headlessFrames = 1;
+	std::string outputPath = "output.ppm";
+
+	// .obj or .glb file, a single triangle when empty
+	std::string scenePath;
+
+	// Average samples over frames until the scene changes
+	bool accumulate = true;
+
+	// Path vertices traced per sample, 1 shows only directly visible surfaces
+	uint32_t maxDepth = 8;
+
+	// Driver pipeline cache, loaded at startup and saved at shutdown
+	std::string pipelineCachePath = "pipeline_cache.bin";
+
+	// GPU timing summary written at exit (.json or CSV), none when empty
+	std::string profileLogPath;
+
+	// Recompile shaders and rebuild the pipeline when a source file changes
+	bool hotReload = false;
+
+	// Output primary hit normals instead of path tracing, see RenderView
+	bool normalView = false;
+
+	// Worker threads recording command buffers, 0 uses every core
+	uint32_t jobThreads = 0;
+
+	// Upload on a dedicated transfer queue and build BLASes on an async
+	// compute queue when the device has them
+	bool asyncQueues = true;
+
+	// Turn every scene node about the up axis, refitting the TLAS each frame
+	bool animate = false;
+
+	// Deform the first mesh every frame; its BLAS is refit in place and
+	// rebuilt after maxRefits refits (0 rebuilds every frame)
+	bool deform = false;
+	uint32_t maxRefits = 16;
+};
+
+// Where a mesh lives inside the scene's shared vertex and index buffers
+struct MeshRange {
+	uint32_t firstVertex;
+	uint32_t vertexCount;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+// Must match Material in closesthit.rchit
+struct GpuMaterial {
+	glm::vec4 baseColor;
+	glm::vec4 emissive;  // w: roughness
+	float metallic;
+	int32_t baseColorTexture;
+	float pad[2];
+};
+
+// Inline data of a mesh's primary hit record, read through shaderRecordEXT.
+// Must match HitRecord in closesthit.rchit.
+struct HitRecordData {
+	vk::DeviceAddress vertexAddress;
+	vk::DeviceAddress indexAddress;
+	GpuMaterial material;
+};
+
+// Ray types traced by raygen.rgen, each with its own miss and hit group
+enum RayType : uint32_t {
+	rayTypePrimary,
+	rayTypeShadow,
+	rayTypeCount,
+};
+
+// What raygen writes to the output image. The normal view is deterministic
+// and matches the CPU reference renderer (reference.hpp) pixel for pixel.
+enum RenderView : uint32_t {
+	renderViewPathTraced,
+	renderViewNormals,
+};
+
+// Must match the push constant block in raygen.rgen
+struct PushConstants {
+	glm::vec4 origin;   // w: lens radius
+	glm::vec4 forward;  // w: focus distance
+	glm::vec4 right;    // w: tan(fovY / 2)
+	glm::vec4 up;       // w: aspect ratio
+	glm::vec4 sun;      // xyz: direction towards the sun, w: irradiance
+	uint32_t frame;
+	uint32_t maxDepth;
+	uint32_t seed;
+	uint32_t view;  // RenderView
+};
+
+// Resources owned by one frame in flight. The fence guards reuse of the
+// command buffer and descriptor set once the ring wraps around.
+struct Frame {
+	vk::UniqueCommandBuffer commandBuffer;
+	vk::UniqueFence inFlightFence;
+	vk::UniqueSemaphore imageAvailableSemaphore;
+};
+
+class Application
+{
+public:
+	explicit Application(const AppOptions& options) : options(options) {}
+
+	// Renders the given scene instead of the built-in triangle or scenePath
+	void setScene(Scene scene) {
+		this->scene = std::move(scene);
+	}
+
+	void run() {
+		auto startTime = std::chrono::steady_clock::now();
+		if (options.headless) {
+			initVulkan();
+			logStartupTime(startTime);
+			renderHeadless();
+			shutdown();
+			return;
+		}
+
+		initWindow();
+		initVulkan();
+		logStartupTime(startTime);
+
+		while (!glfwWindowShouldClose(window)) {
+			glfwPollEvents();
+			drawFrame();
+		}
+
+		device->waitIdle();
+		shutdown();
+
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+
+	// Measurements of the last run, used by the benchmark
+	double getStartupTime() const { return startupTime; }
+	double getRenderTime() const { return renderTime; }
+	const GpuProfiler& getProfiler() const { return profiler; }
+	MemoryStats getMemoryStats() const { return allocator.getStats(); }
+	vk::PhysicalDeviceProperties getDeviceProperties() const { return physicalDevice.getProperties(); }
+	vk::Extent2D getExtent() const { return swapchainExtent; }
+
+private:
+	AppOptions options;
+	double startupTime = 0.0;
+	double renderTime = 0.0;
+
+	vk::UniqueRenderPass renderPass;
+	ImDrawData* draw_data;
+	ImGuiContext* imGuicontext;
+
+	GLFWwindow* window = nullptr;
+
+	vk::UniqueInstance instance;
+	vk::UniqueDebugUtilsMessengerEXT debugMessenger;
+	vk::UniqueSurfaceKHR surface;
+
+	vk::PhysicalDevice physicalDevice;
+	vk::UniqueDevice device;
+	MemoryAllocator allocator;
+
+	vk::Queue queue;
+	uint32_t queueFamilyIndex{};
+
+	// Uploads and BLAS builds; the same queue as `queue` without dedicated families
+	vkutils::QueueFamilies queueFamilies;
+	vk::Queue computeQueue;
+	vk::Queue transferQueue;
+
+	vk::UniqueCommandPool commandPool;
+	StagingRing stagingRing;
+
+	// One-off GPU work such as layout transitions and AS builds, submitted
+	// without blocking; frames wait for everything submitted so far
+	GpuScheduler graphicsScheduler;
+	GpuScheduler computeScheduler;
+	GpuTicket bottomAccelsBuilt;
+	GpuTicket topAccelBuilt;  // initial build, waited on by the first prepareScene()
+	vkutils::TimelineWait geometryUploaded;
+
+	// Signaled by every frame submission, uploads on other queues wait for it
+	vk::UniqueSemaphore renderTimeline;
+	uint64_t renderTimelineValue = 0;
+	GpuProfiler profiler;
+
+	// Frame passes record into secondary command buffers on these threads
+	JobSystem jobs;
+	ParallelRecorder recorder;
+	std::vector<Frame> frames;
+	uint32_t currentFrame = 0;
+
+	vk::SurfaceFormatKHR surfaceFormat;
+	vk::UniqueSwapchainKHR swapchain;
+	std::vector<vk::Image> swapchainImages;
+	std::vector<vk::UniqueImageView> swapchainImageViews;
+	std::vector<vk::UniqueFramebuffer> swapchainFramebuffers;
+	std::vector<vk::UniqueSemaphore> renderCompleteSemaphores;
+	// Fence of the frame that last rendered to each image, null until used
+	std::vector<vk::Fence> imagesInFlight;
+
+	vk::Extent2D swapchainExtent;
+
+	// Render target used instead of the swapchain in headless mode
+	Image offscreenImage;
+	const vk::Format offscreenFormat = vk::Format::eR8G8B8A8Unorm;
+
+	// HDR running mean of the samples traced since the last reset
+	Image accumImage;
+	uint32_t accumFrame = 0;
+	uint32_t sampleSeed = 0;  // never reset, decorrelates frames without accumulation
+
+	Camera camera;
+
+	// Directional light sampled with shadow rays at every bounce
+	glm::vec3 sunDirection{ 0.4f, 1.0f, 0.3f };
+	float sunIntensity = 3.0f;
+	std::chrono::steady_clock::time_point lastFrameTime = std::chrono::steady_clock::now();
+
+	Scene scene;
+	std::vector<MeshRange> meshRanges;
+	Buffer vertexBuffer;
+	Buffer indexBuffer;
+
+	// Textures are indexed bindlessly; geometry and material parameters
+	// live inline in each mesh's hit record
+	std::vector<Image> textures;
+	vk::UniqueSampler textureSampler;
+
+	std::vector<AccelStruct> bottomAccels;
+	DynamicTopLevelAS topAccel{};
+
+	// TLAS instance of each scene node; hidden nodes are removed from the TLAS
+	struct NodeInstance {
+		DynamicTopLevelAS::InstanceId id = 0;
+		bool visible = true;
+	};
+	std::vector<NodeInstance> nodeInstances;
+	uint64_t animationFrame = 0;
+
+	// With deform, bottomAccels[0] is updatable and refit every frame
+	BlasInput deformInput;
+	std::vector<Vertex> deformedVertices;
+	float deformAmplitude = 0.0f;
+	bool deformPending = false;
+
+	std::vector<vk::UniqueShaderModule> shaderModules;
+	std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
+	std::vector<vk::RayTracingShaderGroupCreateInfoKHR> shaderGroups;
+	uint32_t raygenGroupCount = 0;
+	uint32_t missGroupCount = 0;
+	uint32_t hitGroupCount = 0;
+
+	vk::UniqueDescriptorPool descPool;
+	vk::UniqueDescriptorPool imGuiDescPool;
+	vk::UniqueDescriptorSetLayout descSetLayout;
+	std::vector<vk::UniqueDescriptorSet> descSets;
+	std::vector<vk::AccelerationStructureKHR> descSetTlas;  // TLAS each set points to
+
+	vk::UniquePipelineCache pipelineCache;
+	vk::UniquePipeline pipeline;
+	vk::UniquePipelineLayout pipelineLayout;
+
+	ShaderBindingTable sbt;
+
+	// Shader hot reload. The watcher thread leaves a finished pipeline in
+	// reloadedPipeline; the frame loop swaps it in and keeps the replaced
+	// pipeline until the frames in flight that used it have completed.
+	struct RetiredPipeline {
+		vk::UniquePipeline pipeline;
+		ShaderBindingTable sbt;
+		uint64_t lastFrame;
+	};
+	std::mutex reloadMutex;
+	vk::UniquePipeline reloadedPipeline;
+	std::deque<RetiredPipeline> retiredPipelines;
+	// SBT buffers replaced by a material edit, freed the same way
+	struct RetiredBuffer {
+		Buffer buffer;
+		uint64_t lastFrame;
+	};
+	std::deque<RetiredBuffer> retiredBuffers;
+	uint64_t frameNumber = 0;
+	ShaderReloader shaderReloader;  // last, so its thread stops first
+
+	// Shader stages of the pipeline, compiled from SHADER_ROOT_DIR
+	enum ShaderIndex : uint32_t { raygenShader, missShader, shadowMissShader, chitShader, shaderCount };
+	static constexpr std::array<std::pair<const char*, vk::ShaderStageFlagBits>, shaderCount> shaderSources = { {
+		{ "raygen.rgen", vk::ShaderStageFlagBits::eRaygenKHR },
+		{ "miss.rmiss", vk::ShaderStageFlagBits::eMissKHR },
+		{ "shadow.rmiss", vk::ShaderStageFlagBits::eMissKHR },
+		{ "closesthit.rchit", vk::ShaderStageFlagBits::eClosestHitKHR },
+	} };
+
+	void initWindow() {
+		glfwInit();
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+		window = glfwCreateWindow(width, height, "vulkanRaytracing", nullptr, nullptr);
+	}
+
+	void logStartupTime(std::chrono::steady_clock::time_point startTime) {
+		startupTime = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - startTime).count();
+		std::cout << "Startup time: " << startupTime << " ms\n";
+	}
+
+	// Persists state that outlives the process, the device must be idle
+	void shutdown() {
+		shaderReloader.stop();
+		vkutils::savePipelineCache(*device, *pipelineCache, options.pipelineCachePath);
+
+		// Releases what pending submissions kept alive
+		graphicsScheduler.update();
+		computeScheduler.update();
+
+		profiler.collectAll();
+		if (!options.profileLogPath.empty()) {
+			profiler.writeLog(options.profileLogPath);
+		}
+	}
+
+	void initVulkan() {
+		std::vector<const char*> layers;
+		if (options.validation) {
+			layers.push_back("VK_LAYER_KHRONOS_validation");
+		}
+
+		instance = vkutils::createInstance(VK_API_VERSION_1_2, layers, options.headless);
+		std::cout << "create vulkan instance" << std::endl;
+		if (options.validation) {
+			debugMessenger = vkutils::createDebugMessenger(*instance);
+		}
+		if (!options.headless) {
+			surface = vkutils::createSurface(*instance, window);
+		}
+
+		std::vector<const char*> deviceExtensions = {
+			VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+			VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
+			VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
+			VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
+			VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
+		};
+		if (!options.headless) {
+			deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+		}
+		physicalDevice = vkutils::pickPhysicalDevice(*instance, *surface, deviceExtensions);
+		VkPhysicalDeviceProperties physProp;
+		vkGetPhysicalDeviceProperties(physicalDevice, &physProp);
+		std::cout << "Device Name: " << physProp.deviceName << std::endl;
+
+		queueFamilies = vkutils::findQueueFamilies(physicalDevice, *surface);
+		if (!options.asyncQueues) {
+			queueFamilies.compute = queueFamilies.general;
+			queueFamilies.transfer = queueFamilies.general;
+		}
+		queueFamilyIndex = queueFamilies.general;
+		std::cout << "queue family index: " << queueFamilyIndex << " (compute: " << queueFamilies.compute
+			<< ", transfer: " << queueFamilies.transfer << ")" << std::endl;
+		device = vkutils::createLogicalDevice(physicalDevice, queueFamilies.unique(), deviceExtensions);
+		queue = device->getQueue(queueFamilyIndex, 0);
+		computeQueue = device->getQueue(queueFamilies.compute, 0);
+		transferQueue = device->getQueue(queueFamilies.transfer, 0);
+		allocator.init(physicalDevice, *device);
+		allocator.setSharedQueueFamilies(queueFamilies.unique());
+
+		commandPool = vkutils::createCommandPool(*device, queueFamilyIndex);
+		graphicsScheduler.init(*device, queueFamilyIndex, queue);
+		computeScheduler.init(*device, queueFamilies.compute, computeQueue);
+		renderTimeline = vkutils::createTimelineSemaphore(*device);
+		stagingRing.init(allocator, *device, queueFamilies.transfer, transferQueue, queueFamilyIndex, queue);
+		stagingRing.setOwnerTimeline(*renderTimeline, &renderTimelineValue);
+		profiler.init(physicalDevice, *device, queueFamilyIndex,
+			std::max(options.framesInFlight, 1u));
+		jobs.init(options.jobThreads);
+
+		prepareShaders();
+
+		// Everything below the device runs as a graph on the job system.
+		// Staging ring users are chained (geometry, textures, SBT) since the
+		// ring is not thread safe.
+		StartupGraph startup;
+		auto targets = startup.add("render targets", [this]() { createRenderTargets(); });
+		auto sceneLoaded = startup.add("load scene", [this]() { loadScene(); });
+		auto geometry = startup.add("upload geometry", [this]() { uploadGeometry(); }, { sceneLoaded });
+		auto texturesCreated = startup.add("textures", [this]() { createTextures(); }, { geometry });
+		auto blas = startup.add("BLAS", [this]() { createBottomLevelAS(); }, { geometry });
+		auto tlas = startup.add("TLAS", [this]() { createTopLevelAS(); }, { blas, targets });
+
+		std::vector<StartupGraph::StageId> pipelineInputs{ sceneLoaded };
+		for (uint32_t i = 0; i < shaderCount; i++) {
+			pipelineInputs.push_back(startup.add(std::string("shader ") + shaderSources[i].first,
+				[this, i]() { addShader(i, std::string(shaderSources[i].first) + ".spv", shaderSources[i].second); }));
+		}
+		auto pipelineCreated = startup.add("pipeline", [this]() {
+			createDescSetLayout();
+			createRayTracingPipeline();
+		}, pipelineInputs);
+
+		startup.add("descriptor sets", [this]() {
+			createDescriptorPool();
+			createDescriptorSet();
+		}, { targets, texturesCreated, tlas, pipelineCreated });
+		startup.add("shader binding table", [this]() { createShaderBindingTable(); },
+			{ texturesCreated, pipelineCreated });
+
+		startup.run(jobs);
+		startup.printTimeline();
+
+		stagingRing.finish();
+		allocator.printStats();
+
+		if (!options.headless) {
+			initImGui();
+			ImGui_ImplGlfw_InitForVulkan(window, true);
+		}
+
+		if (options.hotReload && !options.headless) {
+#ifdef GLSLC_EXECUTABLE
+			startShaderReloader();
+#else
+			std::cout << "Shader hot reload is disabled: glslc was not found when configuring the build\n";
+#endif
+		}
+	}
+
+	// Swapchain or offscreen image with the frames in flight, plus the
+	// accumulation image
+	void createRenderTargets() {
+		if (options.headless) {
+			createOffscreenImage();
+			createFrames();
+		}
+		else {
+			surfaceFormat = vkutils::chooseSurfaceFormat(physicalDevice, *surface);
+			swapchain = vkutils::createSwapchain(
+				physicalDevice, *device, *surface, queueFamilyIndex,
+				vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eColorAttachment,
+				surfaceFormat, width, height, swapchainExtent);
+
+			swapchainImages = device->getSwapchainImagesKHR(*swapchain);
+			std::cout << "Number of swapchain images: " << swapchainImages.size() << std::endl;
+
+			createSwapchainImageViews();
+			createFrames();
+
+			createRenderPass();
+			createFramebuffers();
+		}
+		createAccumulationImage();
+	}
+
+	void createOffscreenImage() {
+		std::cout << "Create offscreen image\n";
+
+		swapchainExtent = vk::Extent2D{ width, height };
+		offscreenImage.init(allocator, *device, swapchainExtent, offscreenFormat,
+			vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc);
+
+		// The image stays in general layout for its whole lifetime
+		graphicsScheduler.submit(
+			[&](vk::CommandBuffer commandBuffer) {
+				vkutils::setImageLayout(commandBuffer, *offscreenImage.image,
+					vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+			});
+	}
+
+	void createAccumulationImage() {
+		std::cout << "Create accumulation image\n";
+
+		accumImage.init(allocator, *device, swapchainExtent,
+			vk::Format::eR32G32B32A32Sfloat, vk::ImageUsageFlagBits::eStorage);
+
+		graphicsScheduler.submit(
+			[&](vk::CommandBuffer commandBuffer) {
+				vkutils::setImageLayout(commandBuffer, *accumImage.image,
+					vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+			});
+	}
+
+	// Called whenever what the camera sees changes
+	void resetAccumulation() {
+		accumFrame = 0;
+	}
+
+	void updateCamera() {
+		auto now = std::chrono::steady_clock::now();
+		float deltaTime = std::chrono::duration<float>(now - lastFrameTime).count();
+		lastFrameTime = now;
+
+		const ImGuiIO& io = ImGui::GetIO();
+		if (camera.update(window, deltaTime, io.WantCaptureMouse, io.WantCaptureKeyboard)) {
+			resetAccumulation();
+		}
+	}
+
+	// Host side TLAS work of the frame; any instance change restarts accumulation
+	void prepareScene() {
+		// The initial build reads the instance buffer prepare() writes and
+		// the vertices deformMesh() replaces, so it must finish first
+		if (topAccelBuilt.isValid()) {
+			graphicsScheduler.wait(topAccelBuilt);
+			topAccelBuilt = {};
+		}
+
+		animationFrame++;
+		if (options.animate) {
+			animateNodes();
+		}
+		if (options.deform && !bottomAccels.empty()) {
+			deformMesh();
+		}
+		bool handleChanged = topAccel.prepare(currentFrame);
+		if (handleChanged || topAccel.isBuildPending()) {
+			resetAccumulation();
+		}
+	}
+
+	void createSwapchainImageViews() {
+		for (auto image : swapchainImages) {
+			vk::ImageViewCreateInfo createInfo{};
+			createInfo.setImage(image);
+			createInfo.setViewType(vk::ImageViewType::e2D);
+			createInfo.setFormat(surfaceFormat.format);
+			createInfo.setComponents({ vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eA });
+			createInfo.setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+			swapchainImageViews.push_back(device->createImageViewUnique(createInfo));
+		}
+
+		graphicsScheduler.submit(
+			[&](vk::CommandBuffer commandBuffer) {
+				for (auto image : swapchainImages) {
+					vkutils::setImageLayout(commandBuffer, image,
+						vk::ImageLayout::eUndefined, vk::ImageLayout::ePresentSrcKHR);
+				}
+			});
+	};
+
+	void createFrames() {
+		uint32_t frameCount = std::max(options.framesInFlight, 1u);
+		std::cout << "Frames in flight: " << frameCount << std::endl;
+
+		frames.resize(frameCount);
+		for (auto& frame : frames) {
+			frame.commandBuffer = vkutils::createCommandBuffer(*device, *commandPool);
+			// Signaled so the first wait on each frame returns immediately
+			frame.inFlightFence = device->createFenceUnique(
+				{ vk::FenceCreateFlagBits::eSignaled });
+			frame.imageAvailableSemaphore = device->createSemaphoreUnique({});
+		}
+		recorder.init(*device, queueFamilyIndex, frameCount, jobs);
+
+		// Presentation of an image may still be pending when the next frame
+		// starts, so the render complete semaphore is tied to the image.
+		for (size_t i = 0; i < swapchainImages.size(); i++) {
+			renderCompleteSemaphores.push_back(device->createSemaphoreUnique({}));
+		}
+		imagesInFlight.resize(swapchainImages.size());
+	}
+
+	void createRenderPass() {
+		// Draws ImGui on top of the traced image
+		vk::AttachmentDescription colorAttachment({}, surfaceFormat.format,
+			vk::SampleCountFlagBits::e1,
+			vk::AttachmentLoadOp::eLoad,
+			vk::AttachmentStoreOp::eStore,
+			vk::AttachmentLoadOp::eDontCare,
+			vk::AttachmentStoreOp::eDontCare,
+			vk::ImageLayout::eGeneral,
+			vk::ImageLayout::ePresentSrcKHR);
+
+		vk::AttachmentReference colorAttachmentRef(0, vk::ImageLayout::eColorAttachmentOptimal);
+
+		vk::SubpassDescription subpass({}, vk::PipelineBindPoint::eGraphics, {}, {}, 1, &colorAttachmentRef);
+
+		vk::SubpassDependency dependency{};
+		dependency.setSrcSubpass(VK_SUBPASS_EXTERNAL);
+		dependency.setDstSubpass(0);
+		dependency.setSrcStageMask(vk::PipelineStageFlagBits::eRayTracingShaderKHR);
+		dependency.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite);
+		dependency.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+		dependency.setDstAccessMask(
+			vk::AccessFlagBits::eColorAttachmentRead |
+			vk::AccessFlagBits::eColorAttachmentWrite);
+
+		vk::RenderPassCreateInfo renderPassInfo({}, colorAttachment, subpass, dependency);
+
+		renderPass = device->createRenderPassUnique(renderPassInfo);
+	}
+
+	void createFramebuffers() {
+		swapchainFramebuffers.reserve(swapchainImageViews.size());
+
+		for (auto const& view : swapchainImageViews) {
+			vk::FramebufferCreateInfo framebufferInfo({}, renderPass.get(), view.get(),
+				swapchainExtent.width, swapchainExtent.height, 1);
+			swapchainFramebuffers.push_back(device->createFramebufferUnique(framebufferInfo));
+		}
+	}
+
+	void loadScene() {
+		// A scene given through setScene() is used as is
+		if (scene.meshes.empty() && options.scenePath.empty()) {
+			scene = meshloader::makeTriangleScene();
+		}
+		else if (scene.meshes.empty()) {
+			scene = meshloader::loadScene(options.scenePath, jobs);
+		}
+		if (scene.materials.empty()) {
+			scene.materials.push_back(Material{});
+		}
+	}
+
+	// Packs every mesh into one vertex and one index buffer
+	void uploadGeometry() {
+		uint32_t vertexCount = 0;
+		uint32_t indexCount = 0;
+		for (const auto& mesh : scene.meshes) {
+			meshRanges.push_back({ vertexCount,
+				static_cast<uint32_t>(mesh.vertices.size()),
+				indexCount,
+				static_cast<uint32_t>(mesh.indices.size()) });
+			vertexCount += static_cast<uint32_t>(mesh.vertices.size());
+			indexCount += static_cast<uint32_t>(mesh.indices.size());
+		}
+		if (indexCount == 0) {
+			std::cerr << "Scene has no triangles\n";
+			std::abort();
+		}
+
+		vk::BufferUsageFlags bufferUsage{
+			vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
+			vk::BufferUsageFlagBits::eShaderDeviceAddress |
+			vk::BufferUsageFlagBits::eStorageBuffer |
+			vk::BufferUsageFlagBits::eTransferDst };
+
+		vertexBuffer.init(allocator, *device,
+						  vertexCount * sizeof(Vertex), bufferUsage,
+						  vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+		indexBuffer.init(allocator, *device,
+						 indexCount * sizeof(uint32_t), bufferUsage,
+						 vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+		for (size_t i = 0; i < scene.meshes.size(); i++) {
+			const Mesh& mesh = scene.meshes[i];
+			stagingRing.upload(*vertexBuffer.buffer, meshRanges[i].firstVertex * sizeof(Vertex),
+				mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+			stagingRing.upload(*indexBuffer.buffer, meshRanges[i].firstIndex * sizeof(uint32_t),
+				mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+		}
+		stagingRing.flush();
+		geometryUploaded = stagingRing.getWait();
+	}
+
+	void createTextures() {
+		std::cout << "Create textures: " << scene.textures.size() << "\n";
+
+		vk::SamplerCreateInfo samplerInfo{};
+		samplerInfo.setMagFilter(vk::Filter::eLinear);
+		samplerInfo.setMinFilter(vk::Filter::eLinear);
+		samplerInfo.setAddressModeU(vk::SamplerAddressMode::eRepeat);
+		samplerInfo.setAddressModeV(vk::SamplerAddressMode::eRepeat);
+		samplerInfo.setAddressModeW(vk::SamplerAddressMode::eRepeat);
+		textureSampler = device->createSamplerUnique(samplerInfo);
+
+		const uint8_t white[4] = { 255, 255, 255, 255 };
+		textures.resize(scene.textures.size());
+		for (size_t i = 0; i < textures.size(); i++) {
+			// An image that failed to decode becomes a white texel
+			const Texture& texture = scene.textures[i];
+			bool valid = texture.width > 0 && texture.height > 0;
+			vk::Extent2D extent = valid ? vk::Extent2D{ texture.width, texture.height } : vk::Extent2D{ 1, 1 };
+
+			textures[i].init(allocator, *device, extent, vk::Format::eR8G8B8A8Srgb,
+				vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst);
+			stagingRing.uploadImage(*textures[i].image, extent,
+				valid ? texture.pixels.data() : white, 4);
+		}
+		stagingRing.flush();
+	}
+
+	GpuMaterial toGpuMaterial(const Material& material) const {
+		GpuMaterial gpuMaterial{};
+		gpuMaterial.baseColor = glm::make_vec4(material.baseColor);
+		gpuMaterial.emissive = glm::vec4(glm::make_vec3(material.emissive), material.roughness);
+		gpuMaterial.metallic = material.metallic;
+		gpuMaterial.baseColorTexture =
+			material.baseColorTexture < static_cast<int32_t>(textures.size()) ? material.baseColorTexture : -1;
+		return gpuMaterial;
+	}
+
+	HitRecordData getHitRecordData(uint32_t meshIndex) const {
+		uint32_t material = std::min(scene.meshes[meshIndex].material,
+			static_cast<uint32_t>(scene.materials.size()) - 1);
+
+		HitRecordData data{};
+		data.vertexAddress = vertexBuffer.address + meshRanges[meshIndex].firstVertex * sizeof(Vertex);
+		data.indexAddress = indexBuffer.address + meshRanges[meshIndex].firstIndex * sizeof(uint32_t);
+		data.material = toGpuMaterial(scene.materials[material]);
+		return data;
+	}
+
+	// From the scene, so layouts can be created before the textures are
+	uint32_t getTextureDescriptorCount() const {
+		return std::max(static_cast<uint32_t>(scene.textures.size()), 1u);
+	}
+
+	void createBottomLevelAS() {
+		std::cout << "Create BLAS\n";
+
+		// One BLAS per mesh, all built in a single submission
+		std::vector<BlasInput> inputs(scene.meshes.size());
+		for (size_t i = 0; i < inputs.size(); i++) {
+			const MeshRange& range = meshRanges[i];
+
+			vk::AccelerationStructureGeometryTrianglesDataKHR triangles{};
+			triangles.setVertexFormat(vk::Format::eR32G32B32Sfloat);
+			triangles.setVertexData(vertexBuffer.address + range.firstVertex * sizeof(Vertex));
+			triangles.setVertexStride(sizeof(Vertex));
+			triangles.setMaxVertex(range.vertexCount);
+			triangles.setIndexType(vk::IndexType::eUint32);
+			triangles.setIndexData(indexBuffer.address + range.firstIndex * sizeof(uint32_t));
+
+			BlasInput& input = inputs[i];
+			input.geometries.resize(1);
+			input.geometries[0].setGeometryType(vk::GeometryTypeKHR::eTriangles);
+			input.geometries[0].setGeometry({ triangles });
+			input.geometries[0].setFlags(vk::GeometryFlagBitsKHR::eOpaque);
+
+			input.rangeInfos.resize(1);
+			input.rangeInfos[0].setPrimitiveCount(range.indexCount / 3);
+			input.compact = options.compactAccel;
+		}
+
+		// Built on the compute queue once the geometry upload has landed; the
+		// TLAS build waits for bottomAccelsBuilt on the GPU.
+		// Timing needs timestamp support on that queue.
+		// A deforming first mesh is left out and gets an updatable BLAS of
+		// its own, built together with the TLAS.
+		size_t firstBatched = options.deform && !inputs.empty() ? 1 : 0;
+		std::vector<BlasInput> batchInputs(inputs.begin() + firstBatched, inputs.end());
+		bool timestamps = physicalDevice.getQueueFamilyProperties()[queueFamilies.compute].timestampValidBits > 0;
+		std::vector<CompactionResult> compactionResults;
+		bottomAccels = buildBottomLevelAccelStructs(
+			allocator, *device, computeScheduler, batchInputs,
+			256ull << 20, &compactionResults, timestamps ? &profiler : nullptr,
+			{ geometryUploaded }, &bottomAccelsBuilt);
+
+		if (firstBatched > 0) {
+			deformInput = inputs[0];
+			AccelStruct deforming;
+			deforming.initUpdatable(allocator, *device, deformInput, options.maxRefits);
+			bottomAccels.insert(bottomAccels.begin(), std::move(deforming));
+			deformPending = true;
+
+			// A few percent of the mesh size
+			constexpr float inf = std::numeric_limits<float>::infinity();
+			float lower[3] = { inf, inf, inf };
+			float upper[3] = { -inf, -inf, -inf };
+			for (const Vertex& vertex : scene.meshes[0].vertices) {
+				for (int axis = 0; axis < 3; axis++) {
+					lower[axis] = std::min(lower[axis], vertex.pose[axis]);
+					upper[axis] = std::max(upper[axis], vertex.pose[axis]);
+				}
+			}
+			deformAmplitude = 0.02f * std::max({ upper[0] - lower[0], upper[1] - lower[1], upper[2] - lower[2] });
+		}
+
+		for (const auto& result : compactionResults) {
+			std::cout << "  BLAS " << result.index + firstBatched << ": "
+				<< result.originalSize << " -> " << result.compactedSize << " bytes, saved "
+				<< result.originalSize - result.compactedSize << "\n";
+		}
+	}
+
+	// The custom index selects the mesh
+	vk::AccelerationStructureInstanceKHR makeInstance(const SceneNode& node) const {
+		vk::AccelerationStructureInstanceKHR accelInstance{};
+		accelInstance.setTransform(vk::TransformMatrixKHR{ node.transform });
+		accelInstance.setInstanceCustomIndex(node.mesh);
+		accelInstance.setMask(0xFF);
+		accelInstance.setInstanceShaderBindingTableRecordOffset(node.mesh * rayTypeCount);
+		accelInstance.setFlags(
+			vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable);
+		accelInstance.setAccelerationStructureReference(
+			bottomAccels[node.mesh].buffer.address);
+		return accelInstance;
+	}
+
+	void createTopLevelAS() {
+		std::cout << "Create TLAS\n";
+
+		topAccel.init(allocator, *device, static_cast<uint32_t>(frames.size()),
+			std::max(static_cast<uint32_t>(scene.nodes.size()), 1024u));
+
+		// One instance per scene node
+		nodeInstances.resize(scene.nodes.size());
+		for (size_t i = 0; i < scene.nodes.size(); i++) {
+			nodeInstances[i].id = topAccel.addInstance(makeInstance(scene.nodes[i]));
+		}
+
+		// Initial build, later changes are applied in the frame's command buffer
+		topAccel.prepare(currentFrame);
+		topAccelBuilt = graphicsScheduler.submit(
+			[&](vk::CommandBuffer commandBuffer) {
+				profiler.beginFrame(commandBuffer, profiler.getImmediateSlot());
+				profiler.beginScope(commandBuffer, "TLAS initial build");
+				recordDeformUpdate(commandBuffer);
+				topAccel.record(commandBuffer);
+				profiler.endScope(commandBuffer);
+			},
+			{ bottomAccelsBuilt.asWait(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR), geometryUploaded });
+		graphicsScheduler.then(topAccelBuilt, [this]() {
+			profiler.collect(profiler.getImmediateSlot());
+		});
+	}
+
+	// Adding a node back or removing it rebuilds the TLAS next frame
+	void setNodeVisible(size_t node, bool visible) {
+		NodeInstance& instance = nodeInstances[node];
+		if (visible == instance.visible) {
+			return;
+		}
+		if (visible) {
+			instance.id = topAccel.addInstance(makeInstance(scene.nodes[node]));
+		}
+		else {
+			topAccel.removeInstance(instance.id);
+		}
+		instance.visible = visible;
+	}
+
+	// A fixed step per frame keeps headless output reproducible. Only the
+	// transforms change, so the TLAS is refit rather than rebuilt.
+	void animateNodes() {
+		float angle = static_cast<float>(animationFrame) * 0.01f;
+		float c = std::cos(angle);
+		float s = std::sin(angle);
+		for (size_t i = 0; i < scene.nodes.size(); i++) {
+			if (!nodeInstances[i].visible) {
+				continue;
+			}
+			// Rotation about +Y applied after the node's own transform
+			const Transform& transform = scene.nodes[i].transform;
+			Transform rotated;
+			for (size_t column = 0; column < 4; column++) {
+				rotated[0][column] = c * transform[0][column] + s * transform[2][column];
+				rotated[1][column] = transform[1][column];
+				rotated[2][column] = -s * transform[0][column] + c * transform[2][column];
+			}
+			topAccel.setTransform(nodeInstances[i].id, vk::TransformMatrixKHR{ rotated });
+		}
+	}
+
+	// Moves the first mesh's vertices along their normals with a wave
+	// travelling up the mesh; normals are kept as loaded. The upload waits
+	// for frames still reading the vertices, and the frame waits for it.
+	void deformMesh() {
+		const Mesh& mesh = scene.meshes[0];
+		deformedVertices = mesh.vertices;
+		float phase = static_cast<float>(animationFrame) * 0.1f;
+		float frequency = 0.5f / std::max(deformAmplitude, 1e-6f);
+		for (Vertex& vertex : deformedVertices) {
+			float offset = deformAmplitude * std::sin(phase + vertex.pose[1] * frequency);
+			for (int axis = 0; axis < 3; axis++) {
+				vertex.pose[axis] += vertex.normal[axis] * offset;
+			}
+		}
+		stagingRing.upload(*vertexBuffer.buffer, meshRanges[0].firstVertex * sizeof(Vertex),
+			deformedVertices.data(), deformedVertices.size() * sizeof(Vertex));
+		stagingRing.flush();
+
+		// Instances referencing the BLAS need a TLAS refit after it changes
+		topAccel.requestUpdate();
+		deformPending = true;
+	}
+
+	// Refit, or a rebuild once the refit budget is spent
+	void recordDeformUpdate(vk::CommandBuffer commandBuffer) {
+		if (!deformPending) {
+			return;
+		}
+		bottomAccels[0].update(commandBuffer, deformInput);
+		deformPending = false;
+	}
+
+	void addShader(uint32_t shaderIndex,
+		const std::string& filename,
+		vk::ShaderStageFlagBits stage) {
+		std::cout << "Loading shader: " << SHADER_ROOT_DIR + filename << std::endl;
+
+		shaderModules[shaderIndex] =
+			vkutils::createShaderModule(*device, SHADER_ROOT_DIR + filename);
+		std::cout << "after createShader" << std::endl;
+		shaderStages[shaderIndex].setStage(stage);
+		shaderStages[shaderIndex].setModule(*shaderModules[shaderIndex]);
+		shaderStages[shaderIndex].setPName("main");
+	}
+
+	// Shader modules are loaded by startup stages, one per shader
+	void prepareShaders() {
+		std::cout << "Prepare shaders\n";
+
+		shaderStages.resize(shaderCount);
+		shaderModules.resize(shaderCount);
+
+		// Miss and hit groups are ordered by ray type, matching the
+		// sbtRecordOffset / missIndex values used in raygen.rgen
+		shaderGroups.clear();
+		addGeneralGroup(raygenShader);
+		raygenGroupCount = 1;
+
+		addGeneralGroup(missShader);
+		addGeneralGroup(shadowMissShader);
+		missGroupCount = rayTypeCount;
+
+		// Shadow rays skip the closest hit shader, so their group is empty
+		addHitGroup(chitShader);
+		addHitGroup(VK_SHADER_UNUSED_KHR);
+		hitGroupCount = rayTypeCount;
+	}
+
+	void addGeneralGroup(uint32_t shader) {
+		vk::RayTracingShaderGroupCreateInfoKHR& group = shaderGroups.emplace_back();
+		group.setType(vk::RayTracingShaderGroupTypeKHR::eGeneral);
+		group.setGeneralShader(shader);
+		group.setClosestHitShader(VK_SHADER_UNUSED_KHR);
+		group.setAnyHitShader(VK_SHADER_UNUSED_KHR);
+		group.setIntersectionShader(VK_SHADER_UNUSED_KHR);
+	}
+
+	void addHitGroup(uint32_t closestHitShader) {
+		vk::RayTracingShaderGroupCreateInfoKHR& group = shaderGroups.emplace_back();
+		group.setType(vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup);
+		group.setGeneralShader(VK_SHADER_UNUSED_KHR);
+		group.setClosestHitShader(closestHitShader);
+		group.setAnyHitShader(VK_SHADER_UNUSED_KHR);
+		group.setIntersectionShader(VK_SHADER_UNUSED_KHR);
+	}
+
+	void createDescriptorPool() {
+		std::vector<vk::DescriptorPoolSize> poolSizes = {
+			{ vk::DescriptorType::eAccelerationStructureKHR, 1},
+			{ vk::DescriptorType::eStorageImage, 2 },
+			{ vk::DescriptorType::eCombinedImageSampler, getTextureDescriptorCount() },
+		};
+		for (auto& poolSize : poolSizes) {
+			poolSize.descriptorCount *= getDescSetCount();
+		}
+
+		vk::DescriptorPoolCreateInfo createInfo{};
+		createInfo.setPoolSizes(poolSizes);
+		createInfo.setMaxSets(getDescSetCount());
+		createInfo.setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
+		descPool = device->createDescriptorPoolUnique(createInfo);
+
+		std::vector<vk::DescriptorPoolSize> imGuiPoolSizes = {
+			{vk::DescriptorType::eSampler,1000},
+			{vk::DescriptorType::eCombinedImageSampler,1000},
+			{vk::DescriptorType::eSampledImage,1000},
+			{vk::DescriptorType::eStorageImage,1000},
+			{vk::DescriptorType::eUniformTexelBuffer,1000},
+			{vk::DescriptorType::eStorageTexelBuffer,1000},
+			{vk::DescriptorType::eUniformBuffer,1000},
+			{vk::DescriptorType::eStorageBuffer,1000},
+			{vk::DescriptorType::eUniformBufferDynamic,1000},
+			{vk::DescriptorType::eStorageBufferDynamic,1000},
+			{vk::DescriptorType::eInputAttachment,1000}
+		};
+
+		vk::DescriptorPoolCreateInfo imGuiPoolInfo = {};
+		imGuiPoolInfo.setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
+		imGuiPoolInfo.setMaxSets(1000);
+		imGuiPoolInfo.poolSizeCount = static_cast<uint32_t>(imGuiPoolSizes.size());
+		imGuiPoolInfo.pPoolSizes = imGuiPoolSizes.data();
+
+		imGuiDescPool = device->createDescriptorPoolUnique(imGuiPoolInfo);
+
+	}
+
+	void createDescSetLayout() {
+		std::vector<vk::DescriptorSetLayoutBinding> bindings(4);
+
+		bindings[0].setBinding(0);
+		bindings[0].setDescriptorType(vk::DescriptorType::eAccelerationStructureKHR);
+		bindings[0].setDescriptorCount(1);
+		bindings[0].setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR);
+
+		bindings[1].setBinding(1);
+		bindings[1].setDescriptorType(vk::DescriptorType::eStorageImage);
+		bindings[1].setDescriptorCount(1);
+		bindings[1].setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR);
+
+		bindings[2].setBinding(2);
+		bindings[2].setDescriptorType(vk::DescriptorType::eStorageImage);
+		bindings[2].setDescriptorCount(1);
+		bindings[2].setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR);
+
+		// Every texture of the scene
+		bindings[3].setBinding(3);
+		bindings[3].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		bindings[3].setDescriptorCount(getTextureDescriptorCount());
+		bindings[3].setStageFlags(vk::ShaderStageFlagBits::eClosestHitKHR);
+
+		// A scene without textures leaves the single array element unwritten
+		std::vector<vk::DescriptorBindingFlags> bindingFlags(bindings.size());
+		bindingFlags[3] = vk::DescriptorBindingFlagBits::ePartiallyBound;
+		vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+		bindingFlagsInfo.setBindingFlags(bindingFlags);
+
+		vk::DescriptorSetLayoutCreateInfo createInfo{};
+		createInfo.setBindings(bindings);
+		createInfo.setPNext(&bindingFlagsInfo);
+		descSetLayout = device->createDescriptorSetLayoutUnique(createInfo);
+	}
+
+	void createDescriptorSet() {
+		std::cout << "Create Descriptor Set\n";
+
+		std::vector<vk::DescriptorSetLayout> layouts(getDescSetCount(), *descSetLayout);
+		vk::DescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.setDescriptorPool(*descPool);
+		allocateInfo.setSetLayouts(layouts);
+		descSets = device->allocateDescriptorSetsUnique(allocateInfo);
+
+		descSetTlas.resize(descSets.size());
+		for (uint32_t i = 0; i < descSets.size(); i++) {
+			writeDescriptorSet(i, options.headless ? *offscreenImage.view : *swapchainImageViews[i]);
+		}
+	}
+
+	// One set per swapchain image, each bound to that image. drawFrame()
+	// waits on imagesInFlight before patching a set, since the image order
+	// is up to the presentation engine and need not follow the frame ring.
+	// Headless mode has one set per frame in flight instead.
+	uint32_t getDescSetCount() const {
+		return static_cast<uint32_t>(options.headless ? frames.size() : swapchainImages.size());
+	}
+
+	void createRayTracingPipeline() {
+		std::cout << "Create pipeline" << std::endl;
+
+		vk::PushConstantRange pushConstantRange{};
+		pushConstantRange.setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR);
+		pushConstantRange.setSize(sizeof(PushConstants));
+
+		vk::PipelineLayoutCreateInfo layoutCreateInfo{};
+		layoutCreateInfo.setSetLayouts(*descSetLayout);
+		layoutCreateInfo.setPushConstantRanges(pushConstantRange);
+		pipelineLayout = device->createPipelineLayoutUnique(layoutCreateInfo);
+
+		pipelineCache = vkutils::loadPipelineCache(
+			*device, physicalDevice, options.pipelineCachePath);
+
+		pipeline = buildPipeline(shaderStages);
+		if (!pipeline) {
+			std::abort();
+		}
+	}
+
+	// Compiles the pipeline as a deferred host operation. Also runs on the
+	// shader watcher thread; the layout, groups and cache it reads do not
+	// change after startup.
+	vk::UniquePipeline buildPipeline(const std::vector<vk::PipelineShaderStageCreateInfo>& stages) {
+		vk::RayTracingPipelineCreateInfoKHR pipelineCreateInfo{};
+		pipelineCreateInfo.setLayout(*pipelineLayout);
+		pipelineCreateInfo.setStages(stages);
+		pipelineCreateInfo.setGroups(shaderGroups);
+		// Bounces are a loop in raygen; hit and miss shaders never trace rays
+		pipelineCreateInfo.setMaxPipelineRayRecursionDepth(1);
+
+		auto startTime = std::chrono::steady_clock::now();
+		vk::UniquePipeline newPipeline = vkutils::createRayTracingPipelineDeferred(
+			*device, *pipelineCache, pipelineCreateInfo,
+			[this](size_t count, const std::function<void(size_t)>& func) { jobs.parallelFor(count, func); });
+		std::cout << "Pipeline creation: " << std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - startTime).count() << " ms\n";
+		return newPipeline;
+	}
+
+	void startShaderReloader() {
+		std::vector<std::string> sources;
+		for (const auto& [name, stage] : shaderSources) {
+			sources.push_back(name);
+		}
+		shaderReloader.start(SHADER_ROOT_DIR, sources, [this]() { rebuildPipeline(); });
+	}
+
+	// Watcher thread: builds a pipeline from the recompiled SPIR-V and
+	// leaves it for swapReloadedPipeline()
+	void rebuildPipeline() {
+		std::vector<vk::UniqueShaderModule> modules;
+		std::vector<vk::PipelineShaderStageCreateInfo> stages = shaderStages;
+		for (uint32_t i = 0; i < shaderCount; i++) {
+			modules.push_back(vkutils::createShaderModule(*device,
+				SHADER_ROOT_DIR + std::string(shaderSources[i].first) + ".spv"));
+			stages[i].setModule(*modules.back());
+		}
+
+		vk::UniquePipeline newPipeline = buildPipeline(stages);
+		if (newPipeline) {
+			std::lock_guard<std::mutex> lock(reloadMutex);
+			reloadedPipeline = std::move(newPipeline);
+		}
+	}
+
+	// Frame loop, before recording: installs a reloaded pipeline with a new
+	// SBT and frees replaced ones no frame in flight can still use
+	void swapReloadedPipeline() {
+		while (!retiredPipelines.empty() &&
+			retiredPipelines.front().lastFrame + frames.size() <= frameNumber) {
+			retiredPipelines.pop_front();
+		}
+		while (!retiredBuffers.empty() &&
+			retiredBuffers.front().lastFrame + frames.size() <= frameNumber) {
+			retiredBuffers.pop_front();
+		}
+
+		vk::UniquePipeline newPipeline;
+		{
+			std::lock_guard<std::mutex> lock(reloadMutex);
+			newPipeline = std::move(reloadedPipeline);
+		}
+		if (!newPipeline) {
+			return;
+		}
+
+		retiredPipelines.push_back({ std::move(pipeline), std::move(sbt), frameNumber });
+		pipeline = std::move(newPipeline);
+		sbt = ShaderBindingTable{};
+		createShaderBindingTable();
+		resetAccumulation();
+		std::cout << "Reloaded shaders\n";
+	}
+
+	// Group order from prepareShaders: raygen, then one miss and one hit
+	// group per ray type. Every mesh gets one hit record per ray type.
+	void createShaderBindingTable() {
+		uint32_t missGroupBase = raygenGroupCount;
+		uint32_t hitGroupBase = raygenGroupCount + missGroupCount;
+
+		sbt.init(physicalDevice, *device);
+		sbt.addRecord(ShaderBindingTable::regionRaygen, 0);
+		for (uint32_t rayType = 0; rayType < rayTypeCount; rayType++) {
+			sbt.addRecord(ShaderBindingTable::regionMiss, missGroupBase + rayType);
+		}
+		for (uint32_t mesh = 0; mesh < scene.meshes.size(); mesh++) {
+			HitRecordData data = getHitRecordData(mesh);
+			sbt.addRecord(ShaderBindingTable::regionHit, hitGroupBase + rayTypePrimary, &data, sizeof(data));
+			sbt.addRecord(ShaderBindingTable::regionHit, hitGroupBase + rayTypeShadow);
+		}
+		sbt.build(allocator, stagingRing, *pipeline);
+		stagingRing.flush();
+	}
+
+	// Rewrites the hit records of every mesh using a material; frames
+	// submitted afterwards see the new values. A table that had to grow
+	// retires its old buffer until earlier frames are done with it.
+	void updateMaterial(uint32_t materialIndex) {
+		for (uint32_t mesh = 0; mesh < scene.meshes.size(); mesh++) {
+			if (scene.meshes[mesh].material == materialIndex) {
+				HitRecordData data = getHitRecordData(mesh);
+				sbt.setRecordData(ShaderBindingTable::regionHit,
+					mesh * rayTypeCount + rayTypePrimary, &data, sizeof(data));
+			}
+		}
+		Buffer replaced = sbt.updateRegion(allocator, stagingRing, ShaderBindingTable::regionHit);
+		if (replaced.buffer) {
+			retiredBuffers.push_back({ std::move(replaced), frameNumber });
+		}
+		stagingRing.flush();
+		resetAccumulation();
+	}
+
+	void drawFrame() {
+		Frame& frame = frames[currentFrame];
+
+		// Wait until the GPU has finished with this frame's resources
+		if (device->waitForFences(*frame.inFlightFence, VK_TRUE,
+			std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess) {
+			std::cerr << "Failed to wait for fence.\n";
+			std::abort();
+		}
+
+		auto result = device->acquireNextImageKHR(
+			*swapchain, std::numeric_limits<uint64_t>::max(), *frame.imageAvailableSemaphore);
+
+		if (result.result != vk::Result::eSuccess &&
+			result.result != vk::Result::eSuboptimalKHR) {
+			std::cerr << "Failed to acquire next image.\n";
+			std::abort();
+		}
+
+		uint32_t imageIndex = result.value;
+
+		// Another frame in flight may still use this image's descriptor set
+		// and render complete semaphore
+		vk::Fence imageFence = imagesInFlight[imageIndex];
+		if (imageFence && imageFence != *frame.inFlightFence) {
+			if (device->waitForFences(imageFence, VK_TRUE,
+				std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess) {
+				std::cerr << "Failed to wait for fence.\n";
+				std::abort();
+			}
+		}
+		imagesInFlight[imageIndex] = *frame.inFlightFence;
+
+		device->resetFences(*frame.inFlightFence);
+		swapReloadedPipeline();
+
+		updateCamera();
+		prepareScene();
+		deawImGui();
+
+		updateDescriptorSetTlas(imageIndex);
+		recordCommandBuffer(*frame.commandBuffer, imageIndex);
+
+		submitFrame(*frame.commandBuffer, *frame.inFlightFence,
+			*frame.imageAvailableSemaphore, *renderCompleteSemaphores[imageIndex]);
+
+		vk::PresentInfoKHR presentInfo{};
+		presentInfo.setWaitSemaphores(*renderCompleteSemaphores[imageIndex]);
+		presentInfo.setSwapchains(*swapchain);
+		presentInfo.setImageIndices(imageIndex);
+		if (queue.presentKHR(presentInfo) != vk::Result::eSuccess) {
+			std::cerr << "Failed to present\n";
+			std::abort();
+		}
+
+		currentFrame = (currentFrame + 1) % static_cast<uint32_t>(frames.size());
+		frameNumber++;
+	}
+
+	// Frames wait for the staging ring's uploads and advance renderTimeline,
+	// which uploads on another queue wait for in turn
+	void submitFrame(vk::CommandBuffer commandBuffer, vk::Fence fence,
+		vk::Semaphore imageAvailable = {}, vk::Semaphore renderComplete = {}) {
+		graphicsScheduler.update();
+		computeScheduler.update();
+
+		std::vector<vk::Semaphore> waitSemaphores{ stagingRing.getTimeline() };
+		std::vector<uint64_t> waitValues{ stagingRing.getSubmittedValue() };
+		std::vector<vk::PipelineStageFlags> waitStages{ vk::PipelineStageFlagBits::eAllCommands };
+		for (const GpuTicket& ticket : { graphicsScheduler.getLastTicket(), computeScheduler.getLastTicket() }) {
+			if (ticket.isValid()) {
+				waitSemaphores.push_back(ticket.semaphore);
+				waitValues.push_back(ticket.value);
+				waitStages.push_back(vk::PipelineStageFlagBits::eAllCommands);
+			}
+		}
+		if (imageAvailable) {
+			waitSemaphores.push_back(imageAvailable);
+			waitValues.push_back(0);  // binary, the value is ignored
+			waitStages.push_back(vk::PipelineStageFlagBits::eRayTracingShaderKHR);
+		}
+
+		std::vector<vk::Semaphore> signalSemaphores{ *renderTimeline };
+		std::vector<uint64_t> signalValues{ ++renderTimelineValue };
+		if (renderComplete) {
+			signalSemaphores.push_back(renderComplete);
+			signalValues.push_back(0);
+		}
+
+		vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.setWaitSemaphoreValues(waitValues);
+		timelineInfo.setSignalSemaphoreValues(signalValues);
+
+		vk::SubmitInfo submitInfo{};
+		submitInfo.setCommandBuffers(commandBuffer);
+		submitInfo.setWaitSemaphores(waitSemaphores);
+		submitInfo.setWaitDstStageMask(waitStages);
+		submitInfo.setSignalSemaphores(signalSemaphores);
+		submitInfo.setPNext(&timelineInfo);
+		vkutils::submitToQueue(queue, submitInfo, fence);
+	}
+
+	void writeDescriptorSet(uint32_t index, vk::ImageView imageView) {
+		// DescriptorSetshadersɊe_,esNZɋʂĎg郊\[X܂Ƃ߂
+		// TLASƌʂނ߂̃C[Wʃ\[XƂĐݒ肳Ă
+		// C[WɊւĂ̓Xbv`F[~ڂ݂Ȏw̎d
+
+		std::vector<vk::WriteDescriptorSet> writes(3);
+
+		vk::WriteDescriptorSetAccelerationStructureKHR accelInfo{};
+		vk::AccelerationStructureKHR tlas = topAccel.get();
+		accelInfo.setAccelerationStructures(tlas);
+		descSetTlas[index] = tlas;
+
+		writes[0].setDstSet(*descSets[index]);
+		writes[0].setDstBinding(0);
+		writes[0].setDescriptorCount(1);
+		writes[0].setDescriptorType(vk::DescriptorType::eAccelerationStructureKHR);
+		writes[0].setPNext(&accelInfo);
+
+		vk::DescriptorImageInfo imageInfo{};
+		imageInfo.setImageView(imageView);
+		imageInfo.setImageLayout(vk::ImageLayout::eGeneral);
+
+		writes[1].setDstSet(*descSets[index]);
+		writes[1].setDstBinding(1);
+		writes[1].setDescriptorType(vk::DescriptorType::eStorageImage);
+		writes[1].setImageInfo(imageInfo);
+
+		vk::DescriptorImageInfo accumImageInfo{};
+		accumImageInfo.setImageView(*accumImage.view);
+		accumImageInfo.setImageLayout(vk::ImageLayout::eGeneral);
+
+		writes[2].setDstSet(*descSets[index]);
+		writes[2].setDstBinding(2);
+		writes[2].setDescriptorType(vk::DescriptorType::eStorageImage);
+		writes[2].setImageInfo(accumImageInfo);
+
+		std::vector<vk::DescriptorImageInfo> textureInfos;
+		for (const auto& texture : textures) {
+			textureInfos.push_back({ *textureSampler, *texture.view, vk::ImageLayout::eShaderReadOnlyOptimal });
+		}
+		if (!textureInfos.empty()) {
+			vk::WriteDescriptorSet& textureWrite = writes.emplace_back();
+			textureWrite.setDstSet(*descSets[index]);
+			textureWrite.setDstBinding(3);
+			textureWrite.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+			textureWrite.setImageInfo(textureInfos);
+		}
+
+		device->updateDescriptorSets(writes, nullptr);
+	}
+
+	// The images never change; only the TLAS binding goes stale, when the
+	// TLAS was reallocated to grow. Called right before the set is recorded.
+	void updateDescriptorSetTlas(uint32_t index) {
+		vk::AccelerationStructureKHR tlas = topAccel.get();
+		if (descSetTlas[index] == tlas) {
+			return;
+		}
+		descSetTlas[index] = tlas;
+
+		vk::WriteDescriptorSetAccelerationStructureKHR accelInfo{};
+		accelInfo.setAccelerationStructures(tlas);
+
+		vk::WriteDescriptorSet write{};
+		write.setDstSet(*descSets[index]);
+		write.setDstBinding(0);
+		write.setDescriptorCount(1);
+		write.setDescriptorType(vk::DescriptorType::eAccelerationStructureKHR);
+		write.setPNext(&accelInfo);
+		device->updateDescriptorSets(write, nullptr);
+	}
+
+	void renderHeadless() {
+		std::cout << "Render " << options.headlessFrames << " headless frames\n";
+		auto startTime = std::chrono::steady_clock::now();
+
+		for (uint32_t i = 0; i < options.headlessFrames; i++) {
+			Frame& frame = frames[currentFrame];
+
+			if (device->waitForFences(*frame.inFlightFence, VK_TRUE,
+				std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess) {
+				std::cerr << "Failed to wait for fence.\n";
+				std::abort();
+			}
+			device->resetFences(*frame.inFlightFence);
+
+			prepareScene();
+			updateDescriptorSetTlas(currentFrame);
+
+			vk::CommandBufferBeginInfo beginInfo{};
+			beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+			frame.commandBuffer->begin(beginInfo);
+			profiler.beginFrame(*frame.commandBuffer, currentFrame);
+			recordTraceRays(*frame.commandBuffer, currentFrame);
+			frame.commandBuffer->end();
+
+			submitFrame(*frame.commandBuffer, *frame.inFlightFence);
+
+			currentFrame = (currentFrame + 1) % static_cast<uint32_t>(frames.size());
+		}
+
+		device->waitIdle();
+		renderTime = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - startTime).count();
+
+		if (!options.outputPath.empty()) {
+			saveOffscreenImage(options.outputPath);
+		}
+	}
+
+	void saveOffscreenImage(const std::string& filename) {
+		std::cout << "Save image: " << filename << std::endl;
+
+		uint32_t imageWidth = swapchainExtent.width;
+		uint32_t imageHeight = swapchainExtent.height;
+
+		Buffer readbackBuffer;
+		readbackBuffer.init(allocator, *device,
+			imageWidth * imageHeight * 4,
+			vk::BufferUsageFlagBits::eTransferDst,
+			vk::MemoryPropertyFlagBits::eHostVisible |
+			vk::MemoryPropertyFlagBits::eHostCoherent);
+
+		GpuTicket copied = graphicsScheduler.submit(
+			[&](vk::CommandBuffer commandBuffer) {
+				vkutils::setImageLayout(commandBuffer, *offscreenImage.image,
+					vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal);
+
+				vk::BufferImageCopy region{};
+				region.setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0, 0, 1 });
+				region.setImageExtent({ imageWidth, imageHeight, 1 });
+				commandBuffer.copyImageToBuffer(*offscreenImage.image,
+					vk::ImageLayout::eTransferSrcOptimal, *readbackBuffer.buffer, region);
+
+				vk::MemoryBarrier hostBarrier{};
+				hostBarrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+				hostBarrier.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+				commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+					vk::PipelineStageFlagBits::eHost, {}, hostBarrier, {}, {});
+
+				vkutils::setImageLayout(commandBuffer, *offscreenImage.image,
+					vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eGeneral);
+			});
+		graphicsScheduler.wait(copied);
+
+		// Binary PPM keeps the output dependency free
+		std::ofstream file(filename, std::ios::binary);
+		if (!file.is_open()) {
+			std::cerr << "Failed to open output file!\n";
+			std::abort();
+		}
+		file << "P6\n" << imageWidth << " " << imageHeight << "\n255\n";
+
+		const uint8_t* pixels = static_cast<const uint8_t*>(readbackBuffer.allocation.mapped());
+		std::vector<uint8_t> row(imageWidth * 3);
+		for (uint32_t y = 0; y < imageHeight; y++) {
+			for (uint32_t x = 0; x < imageWidth; x++) {
+				const uint8_t* pixel = pixels + (y * imageWidth + x) * 4;
+				row[x * 3 + 0] = pixel[0];
+				row[x * 3 + 1] = pixel[1];
+				row[x * 3 + 2] = pixel[2];
+			}
+			file.write(reinterpret_cast<const char*>(row.data()), row.size());
+		}
+	}
+
+	void recordTraceRays(vk::CommandBuffer commandBuffer, uint32_t descSetIndex) {
+		if (deformPending) {
+			profiler.beginScope(commandBuffer, "BLAS update");
+			recordDeformUpdate(commandBuffer);
+			profiler.endScope(commandBuffer);
+		}
+		if (topAccel.isBuildPending()) {
+			profiler.beginScope(commandBuffer, "TLAS build");
+			topAccel.record(commandBuffer);
+			profiler.endScope(commandBuffer);
+		}
+
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, *pipeline);
+
+		commandBuffer.bindDescriptorSets(
+			vk::PipelineBindPoint::eRayTracingKHR,
+			*pipelineLayout,
+			0,
+			*descSets[descSetIndex],
+			nullptr);
+
+		// The previous frame's trace may still be writing the accumulation image
+		vk::MemoryBarrier barrier{};
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite);
+		barrier.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+			vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+			{}, barrier, {}, {});
+
+		PushConstants pushConstants{};
+		pushConstants.origin = glm::vec4(camera.position, 0.5f * camera.aperture);
+		pushConstants.forward = glm::vec4(camera.getForward(), camera.focusDistance);
+		pushConstants.right = glm::vec4(camera.getRight(), std::tan(0.5f * glm::radians(camera.fovY)));
+		pushConstants.up = glm::vec4(camera.getUp(),
+			static_cast<float>(swapchainExtent.width) / static_cast<float>(swapchainExtent.height));
+		glm::vec3 toSun = glm::dot(sunDirection, sunDirection) > 0.0f
+			? glm::normalize(sunDirection) : glm::vec3(0.0f, 1.0f, 0.0f);
+		pushConstants.sun = glm::vec4(toSun, sunIntensity);
+		pushConstants.frame = options.accumulate ? accumFrame++ : 0;
+		pushConstants.maxDepth = options.maxDepth;
+		pushConstants.seed = sampleSeed++;
+		pushConstants.view = options.normalView ? renderViewNormals : renderViewPathTraced;
+		commandBuffer.pushConstants(*pipelineLayout,
+			vk::ShaderStageFlagBits::eRaygenKHR, 0, sizeof(PushConstants), &pushConstants);
+
+		profiler.beginScope(commandBuffer, "Trace rays");
+		commandBuffer.traceRaysKHR(
+			sbt.getRegion(ShaderBindingTable::regionRaygen),
+			sbt.getRegion(ShaderBindingTable::regionMiss),
+			sbt.getRegion(ShaderBindingTable::regionHit),
+			{},
+			swapchainExtent.width, swapchainExtent.height, 1);
+		profiler.endScope(commandBuffer);
+	}
+
+	void recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t imageIndex) {
+		vk::Image image = swapchainImages[imageIndex];
+
+		vk::CommandBufferBeginInfo beginInfo{};
+		beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		commandBuffer.begin(beginInfo);
+		profiler.beginFrame(commandBuffer, currentFrame);
+
+		// Passes only depend on each other through the order the primary
+		// buffer executes them in, so they are recorded in parallel
+		ImGui::Render();
+		draw_data = ImGui::GetDrawData();
+		recorder.beginFrame(currentFrame);
+		uint32_t tracePass = recorder.addPass([&](vk::CommandBuffer secondary) {
+			vkutils::setImageLayout(secondary, image,
+				vk::ImageLayout::ePresentSrcKHR, vk::ImageLayout::eGeneral);
+			recordTraceRays(secondary, imageIndex);
+		});
+		uint32_t imGuiPass = recorder.addPass([&](vk::CommandBuffer secondary) {
+			profiler.beginScope(secondary, "ImGui");
+			ImGui_ImplVulkan_RenderDrawData(draw_data, secondary);
+			profiler.endScope(secondary);
+		}, *renderPass, 0, *swapchainFramebuffers[imageIndex]);
+		std::vector<vk::CommandBuffer> passes = recorder.record();
+
+		commandBuffer.executeCommands(passes[tracePass]);
+
+		// The render pass loads the traced image and leaves it in present layout
+		vk::RenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.setRenderPass(*renderPass);
+		renderPassInfo.setFramebuffer(*swapchainFramebuffers[imageIndex]);
+		renderPassInfo.setRenderArea({ { 0, 0 }, swapchainExtent });
+
+		commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+		commandBuffer.executeCommands(passes[imGuiPass]);
+		commandBuffer.endRenderPass();
+
+		commandBuffer.end();
+	}
+
+	void initImGui() {
+		imGuicontext = ImGui::CreateContext();
+		ImGui::SetCurrentContext(imGuicontext);
+
+		ImGui_ImplVulkan_InitInfo initInfo = {};
+		initInfo.Instance = instance.get();
+		initInfo.PhysicalDevice = static_cast<VkPhysicalDevice>(physicalDevice);
+		initInfo.Device = device.get();
+		initInfo.QueueFamily = queueFamilyIndex;
+		initInfo.Queue = queue;
+		initInfo.PipelineCache = *pipelineCache;
+		initInfo.DescriptorPool = *imGuiDescPool;
+		initInfo.Allocator = nullptr;
+		initInfo.MinImageCount = 2;
+		initInfo.ImageCount = swapchainImages.size();
+		initInfo.RenderPass = renderPass.get();
+		initInfo.CheckVkResultFn = nullptr;
+
+		ImGui_ImplVulkan_Init(&initInfo);
+		ImGui_ImplVulkan_CreateFontsTexture();
+	}
+
+	void deawImGui() {
+		ImGui_ImplGlfw_NewFrame();
+		ImGui_ImplVulkan_NewFrame();
+		ImGui::NewFrame();
+
+		ImGui::Begin("Camera");
+		bool cameraChanged = false;
+		cameraChanged |= ImGui::DragFloat3("Position", &camera.position.x, 0.05f);
+		cameraChanged |= ImGui::SliderFloat("Yaw", &camera.yaw, -180.0f, 180.0f);
+		cameraChanged |= ImGui::SliderFloat("Pitch", &camera.pitch, -89.0f, 89.0f);
+		cameraChanged |= ImGui::SliderFloat("FOV", &camera.fovY, 10.0f, 120.0f);
+		cameraChanged |= ImGui::SliderFloat("Aperture", &camera.aperture, 0.0f, 1.0f);
+		cameraChanged |= ImGui::DragFloat("Focus distance", &camera.focusDistance, 0.05f, 0.01f, 1000.0f);
+		ImGui::SliderFloat("Move speed", &camera.moveSpeed, 0.1f, 50.0f);
+		int maxDepth = static_cast<int>(options.maxDepth);
+		if (ImGui::SliderInt("Max depth", &maxDepth, 1, 32)) {
+			options.maxDepth = static_cast<uint32_t>(maxDepth);
+			cameraChanged = true;
+		}
+		cameraChanged |= ImGui::DragFloat3("Sun direction", &sunDirection.x, 0.01f, -1.0f, 1.0f);
+		cameraChanged |= ImGui::SliderFloat("Sun intensity", &sunIntensity, 0.0f, 20.0f);
+		ImGui::End();
+		if (cameraChanged) {
+			resetAccumulation();
+		}
+
+		// Edits only re-upload the hit region of the shader binding table
+		ImGui::Begin("Materials");
+		for (uint32_t i = 0; i < scene.materials.size(); i++) {
+			Material& material = scene.materials[i];
+			ImGui::PushID(static_cast<int>(i));
+			if (ImGui::TreeNode("material", "Material %u", i)) {
+				bool changed = false;
+				changed |= ImGui::ColorEdit3("Base color", material.baseColor);
+				changed |= ImGui::ColorEdit3("Emissive", material.emissive, ImGuiColorEditFlags_HDR);
+				changed |= ImGui::SliderFloat("Roughness", &material.roughness, 0.0f, 1.0f);
+				changed |= ImGui::SliderFloat("Metallic", &material.metallic, 0.0f, 1.0f);
+				if (changed) {
+					updateMaterial(i);
+				}
+				ImGui::TreePop();
+			}
+			ImGui::PopID();
+		}
+		ImGui::End();
+
+		// Visibility changes add or remove TLAS instances
+		ImGui::Begin("Scene");
+		ImGui::Checkbox("Animate", &options.animate);
+		ImGuiListClipper clipper;
+		clipper.Begin(static_cast<int>(scene.nodes.size()));
+		while (clipper.Step()) {
+			for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+				bool visible = nodeInstances[i].visible;
+				std::string label = "Node " + std::to_string(i) + " (mesh " + std::to_string(scene.nodes[i].mesh) + ")";
+				if (ImGui::Checkbox(label.c_str(), &visible)) {
+					setNodeVisible(static_cast<size_t>(i), visible);
+				}
+			}
+		}
+		ImGui::End();
+
+		// Rolling GPU timings of the last frames
+		ImGui::Begin("Profiler");
+		if (ImGui::BeginTable("scopes", 5)) {
+			ImGui::TableSetupColumn("Scope");
+			ImGui::TableSetupColumn("Last ms");
+			ImGui::TableSetupColumn("Min ms");
+			ImGui::TableSetupColumn("Avg ms");
+			ImGui::TableSetupColumn("P99 ms");
+			ImGui::TableHeadersRow();
+			for (const auto& stats : profiler.getStats()) {
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(stats.name.c_str());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", stats.last);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", stats.min);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", stats.avg);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", stats.p99);
+			}
+			ImGui::EndTable();
+		}
+		ImGui::End();
+	}
+};
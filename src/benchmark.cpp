@@ -0,0 +1,262 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "application.hpp"
+#include <sstream>
+#include <nlohmann/json.hpp>
+
+// Fixed procedural scenes rendered headlessly; results are written as JSON
+// and optionally compared against a baseline run to catch regressions.
+
+struct BenchmarkScene {
+	std::string name;
+	uint32_t trianglesPerMesh;
+	uint32_t instanceCount;
+};
+
+const std::vector<BenchmarkScene> benchmarkScenes = {
+	{ "triangles-1", 1, 1 },
+	{ "triangles-10k", 10'000, 1 },
+	{ "triangles-1m", 1'000'000, 1 },
+	{ "triangles-10m", 10'000'000, 1 },
+	{ "instances-1k", 1'000, 1'000 },
+	{ "instances-100k", 100, 100'000 },
+};
+
+struct BenchmarkOptions {
+	uint32_t frames = 64;
+	std::vector<std::string> sceneNames;
+	std::string outputPath = "benchmark.json";
+	std::string baselinePath;
+	double tolerance = 0.1;
+	bool validation = false;
+};
+
+// Regular grid in the z = 0 plane covering [-1, 1], cut off at triangleCount
+Mesh makeGridMesh(uint32_t triangleCount) {
+	uint32_t quadCount = (triangleCount + 1) / 2;
+	uint32_t columns = std::max(1u, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(quadCount)))));
+	uint32_t rows = (quadCount + columns - 1) / columns;
+
+	Mesh mesh{};
+	mesh.name = "grid";
+	mesh.vertices.reserve(static_cast<size_t>(columns + 1) * (rows + 1));
+	for (uint32_t y = 0; y <= rows; y++) {
+		for (uint32_t x = 0; x <= columns; x++) {
+			mesh.vertices.push_back({
+				{ 2.0f * x / columns - 1.0f, 2.0f * y / rows - 1.0f, 0.0f },
+				{ 0.0f, 0.0f, 1.0f },
+				{ static_cast<float>(x) / columns, static_cast<float>(y) / rows } });
+		}
+	}
+
+	mesh.indices.reserve(static_cast<size_t>(triangleCount) * 3);
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		uint32_t quad = t / 2;
+		uint32_t x = quad % columns;
+		uint32_t y = quad / columns;
+		uint32_t v0 = y * (columns + 1) + x;
+		uint32_t v1 = v0 + 1;
+		uint32_t v2 = v0 + columns + 1;
+		uint32_t v3 = v2 + 1;
+		if (t % 2 == 0) {
+			mesh.indices.insert(mesh.indices.end(), { v0, v1, v3 });
+		}
+		else {
+			mesh.indices.insert(mesh.indices.end(), { v0, v3, v2 });
+		}
+	}
+	return mesh;
+}
+
+// One grid mesh instanced over a square grid of cells
+Scene makeBenchmarkScene(const BenchmarkScene& desc) {
+	Scene scene;
+	scene.meshes.push_back(makeGridMesh(desc.trianglesPerMesh));
+
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(desc.instanceCount))));
+	float cellSize = 2.0f / side;
+	for (uint32_t i = 0; i < desc.instanceCount; i++) {
+		float scale = 0.45f * cellSize;
+		SceneNode node{};
+		node.mesh = 0;
+		node.transform = { {
+			{ scale, 0.0f, 0.0f, -1.0f + cellSize * (i % side + 0.5f) },
+			{ 0.0f, scale, 0.0f, -1.0f + cellSize * (i / side + 0.5f) },
+			{ 0.0f, 0.0f, scale, 0.0f },
+		} };
+		scene.nodes.push_back(node);
+	}
+	return scene;
+}
+
+double findScope(const GpuProfiler& profiler, const std::string& name, double ScopeStats::* field) {
+	for (const auto& stats : profiler.getStats()) {
+		if (stats.name == name) {
+			return stats.*field;
+		}
+	}
+	return 0.0;
+}
+
+nlohmann::json runScene(const BenchmarkScene& desc, const BenchmarkOptions& benchmarkOptions,
+	nlohmann::json& results) {
+	std::cout << "=== Benchmark scene: " << desc.name << " ===\n";
+
+	AppOptions options{};
+	options.headless = true;
+	options.headlessFrames = benchmarkOptions.frames;
+	options.outputPath = "";
+	options.validation = benchmarkOptions.validation;
+
+	Application app(options);
+	app.setScene(makeBenchmarkScene(desc));
+	app.run();
+
+	const GpuProfiler& profiler = app.getProfiler();
+	vk::Extent2D extent = app.getExtent();
+	double raysPerFrame = static_cast<double>(extent.width) * extent.height;
+	double traceAvg = findScope(profiler, "Trace rays", &ScopeStats::avg);
+	MemoryStats memory = app.getMemoryStats();
+
+	vk::PhysicalDeviceProperties properties = app.getDeviceProperties();
+	results["device"] = std::string(properties.deviceName.data());
+	results["driver_version"] = properties.driverVersion;
+
+	nlohmann::json result;
+	result["name"] = desc.name;
+	result["triangles"] = static_cast<uint64_t>(desc.trianglesPerMesh) * desc.instanceCount;
+	result["instances"] = desc.instanceCount;
+	result["startup_ms"] = app.getStartupTime();
+	result["blas_build_ms"] = findScope(profiler, "BLAS build", &ScopeStats::last);
+	result["tlas_build_ms"] = findScope(profiler, "TLAS initial build", &ScopeStats::last);
+	result["trace_avg_ms"] = traceAvg;
+	result["trace_p99_ms"] = findScope(profiler, "Trace rays", &ScopeStats::p99);
+	double framesPerSecond = app.getRenderTime() > 0.0
+		? benchmarkOptions.frames / (app.getRenderTime() * 1e-3) : 0.0;
+
+	// One primary ray per pixel; bounces and shadow rays are not counted.
+	// Without timestamp support fall back to wall clock time
+	result["primary_rays_per_second"] = traceAvg > 0.0
+		? raysPerFrame / (traceAvg * 1e-3)
+		: raysPerFrame * framesPerSecond;
+	result["frames_per_second"] = framesPerSecond;
+	result["memory_used_bytes"] = memory.bytesUsed;
+	result["memory_reserved_bytes"] = memory.bytesReserved;
+	return result;
+}
+
+// Metrics where larger is better and where smaller is better
+const std::vector<std::string> higherIsBetter = { "primary_rays_per_second" };
+const std::vector<std::string> lowerIsBetter = { "blas_build_ms", "tlas_build_ms", "startup_ms", "memory_used_bytes" };
+
+// Returns the number of metrics that regressed beyond the tolerance
+int compareWithBaseline(const nlohmann::json& results, const BenchmarkOptions& options) {
+	std::ifstream file(options.baselinePath);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open baseline: " << options.baselinePath << "\n";
+		std::abort();
+	}
+	nlohmann::json baseline = nlohmann::json::parse(file);
+
+	int regressions = 0;
+	for (const auto& result : results["scenes"]) {
+		for (const auto& base : baseline["scenes"]) {
+			if (base["name"] != result["name"]) {
+				continue;
+			}
+			auto check = [&](const std::string& metric, bool higher) {
+				double value = result[metric].get<double>();
+				double reference = base.value(metric, 0.0);
+				if (reference <= 0.0) {
+					return;
+				}
+				bool regressed = higher
+					? value < reference * (1.0 - options.tolerance)
+					: value > reference * (1.0 + options.tolerance);
+				if (regressed) {
+					std::cout << "REGRESSION " << result["name"].get<std::string>() << " " << metric
+						<< ": " << value << " (baseline " << reference << ")\n";
+					regressions++;
+				}
+			};
+			for (const auto& metric : higherIsBetter) {
+				check(metric, true);
+			}
+			for (const auto& metric : lowerIsBetter) {
+				check(metric, false);
+			}
+		}
+	}
+	return regressions;
+}
+
+BenchmarkOptions parseBenchmarkOptions(int argc, char** argv) {
+	BenchmarkOptions options{};
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--frames" && i + 1 < argc) {
+			options.frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--scenes" && i + 1 < argc) {
+			std::stringstream names(argv[++i]);
+			for (std::string name; std::getline(names, name, ',');) {
+				auto found = std::find_if(benchmarkScenes.begin(), benchmarkScenes.end(),
+					[&](const BenchmarkScene& scene) { return scene.name == name; });
+				if (found == benchmarkScenes.end()) {
+					std::cerr << "Unknown benchmark scene: " << name << " (see --list)\n";
+					std::abort();
+				}
+				options.sceneNames.push_back(name);
+			}
+		}
+		else if (arg == "--output" && i + 1 < argc) {
+			options.outputPath = argv[++i];
+		}
+		else if (arg == "--baseline" && i + 1 < argc) {
+			options.baselinePath = argv[++i];
+		}
+		else if (arg == "--tolerance" && i + 1 < argc) {
+			options.tolerance = std::stod(argv[++i]);
+		}
+		else if (arg == "--validation") {
+			options.validation = true;
+		}
+		else if (arg == "--list") {
+			for (const auto& scene : benchmarkScenes) {
+				std::cout << scene.name << "\n";
+			}
+			std::exit(0);
+		}
+		else {
+			std::cerr << "Unknown argument: " << arg << "\n";
+			std::abort();
+		}
+	}
+	return options;
+}
+
+int main(int argc, char** argv) {
+	BenchmarkOptions options = parseBenchmarkOptions(argc, argv);
+
+	nlohmann::json results;
+	results["frames"] = options.frames;
+	results["width"] = width;
+	results["height"] = height;
+	results["scenes"] = nlohmann::json::array();
+
+	for (const auto& scene : benchmarkScenes) {
+		if (!options.sceneNames.empty() &&
+			std::find(options.sceneNames.begin(), options.sceneNames.end(), scene.name) == options.sceneNames.end()) {
+			continue;
+		}
+		results["scenes"].push_back(runScene(scene, options, results));
+	}
+
+	std::ofstream file(options.outputPath);
+	file << results.dump(2) << "\n";
+	std::cout << "Write benchmark results: " << options.outputPath << "\n";
+
+	if (!options.baselinePath.empty() && compareWithBaseline(results, options) > 0) {
+		return 1;
+	}
+	return 0;
+}
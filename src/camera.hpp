@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include <utility>
+
+#include <GLFW/glfw3.h>
+#include "cameraview.hpp"
+
+// Fly camera with a thin lens. WASD/QE move, dragging with the right mouse
+// button looks around. Only its push constant data reaches the GPU, so moving
+// it needs no descriptor update or pipeline rebuild.
+struct Camera : CameraView {
+	float moveSpeed = 2.0f;    // units per second
+	float lookSpeed = 0.15f;   // degrees per pixel
+
+	// Applies keyboard and mouse input; returns true when the view changed
+	bool update(GLFWwindow* window, float deltaTime, bool mouseCaptured, bool keyboardCaptured) {
+		bool changed = false;
+
+		double cursorX, cursorY;
+		glfwGetCursorPos(window, &cursorX, &cursorY);
+		bool looking = !mouseCaptured &&
+			glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+		if (looking && wasLooking) {
+			float dx = static_cast<float>(cursorX - lastCursorX);
+			float dy = static_cast<float>(cursorY - lastCursorY);
+			if (dx != 0.0f || dy != 0.0f) {
+				yaw += dx * lookSpeed;
+				pitch = std::clamp(pitch - dy * lookSpeed, -89.0f, 89.0f);
+				changed = true;
+			}
+		}
+		wasLooking = looking;
+		lastCursorX = cursorX;
+		lastCursorY = cursorY;
+
+		if (!keyboardCaptured) {
+			glm::vec3 worldUp{ 0.0f, 1.0f, 0.0f };
+			const std::pair<int, glm::vec3> keyDirections[] = {
+				{ GLFW_KEY_W, getForward() },
+				{ GLFW_KEY_S, -getForward() },
+				{ GLFW_KEY_D, getRight() },
+				{ GLFW_KEY_A, -getRight() },
+				{ GLFW_KEY_E, worldUp },
+				{ GLFW_KEY_Q, -worldUp },
+			};
+
+			glm::vec3 move{ 0.0f };
+			for (const auto& [key, direction] : keyDirections) {
+				if (glfwGetKey(window, key) == GLFW_PRESS) {
+					move += direction;
+				}
+			}
+			if (glm::dot(move, move) > 0.0f) {
+				position += glm::normalize(move) * moveSpeed * deltaTime;
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+private:
+	bool wasLooking = false;
+	double lastCursorX = 0.0;
+	double lastCursorY = 0.0;
+};
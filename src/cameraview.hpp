@@ -0,0 +1,34 @@
+#pragma once
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+// Position, orientation and lens of the camera, without any input handling,
+// so the CPU reference renderer can use it without GLFW
+struct CameraView {
+	glm::vec3 position{ 0.0f, 0.0f, 5.0f };
+	float yaw = -90.0f;  // degrees, -90 looks down -z
+	float pitch = 0.0f;  // degrees
+	float fovY = 37.0f;  // degrees
+
+	// Thin lens, a zero aperture is a pinhole
+	float aperture = 0.0f;
+	float focusDistance = 5.0f;
+
+	glm::vec3 getForward() const {
+		float yawRad = glm::radians(yaw);
+		float pitchRad = glm::radians(pitch);
+		return glm::normalize(glm::vec3(
+			std::cos(pitchRad) * std::cos(yawRad),
+			std::sin(pitchRad),
+			std::cos(pitchRad) * std::sin(yawRad)));
+	}
+
+	glm::vec3 getRight() const {
+		return glm::normalize(glm::cross(getForward(), glm::vec3(0.0f, 1.0f, 0.0f)));
+	}
+
+	glm::vec3 getUp() const {
+		return glm::cross(getRight(), getForward());
+	}
+};
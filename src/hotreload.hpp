@@ -0,0 +1,139 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "config.h"
+
+// Watches shader sources on a background thread and recompiles changed ones
+// with glslc into <name>.spv next to them. Once every changed source compiled
+// the callback runs on the same thread, so the pipeline can be rebuilt
+// without touching the frame loop. Editing an included .glsl file recompiles
+// every source.
+class ShaderReloader {
+public:
+	~ShaderReloader() { stop(); }
+
+	void start(const std::string& sourceDir, const std::vector<std::string>& sources,
+		std::function<void()> onCompiled,
+		std::chrono::milliseconds interval = std::chrono::milliseconds(250)) {
+		std::cout << "Watch shaders: " << sourceDir << "\n";
+
+		this->sourceDir = sourceDir;
+		this->sources = sources;
+		this->onCompiled = std::move(onCompiled);
+		this->interval = interval;
+		timestamps = scan();
+		running = true;
+		thread = std::thread([this]() { run(); });
+	}
+
+	// Waits for a compile or pipeline build in progress to finish
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+		wakeup.notify_all();
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+
+private:
+	using Timestamps = std::map<std::string, std::filesystem::file_time_type>;
+
+	// Modification times of the sources and of every .glsl include
+	Timestamps scan() const {
+		Timestamps result;
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator(sourceDir, error)) {
+			std::string name = entry.path().filename().string();
+			bool isSource = std::find(sources.begin(), sources.end(), name) != sources.end();
+			if (isSource || entry.path().extension() == ".glsl") {
+				result[name] = entry.last_write_time(error);
+			}
+		}
+		return result;
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!wakeup.wait_for(lock, interval, [this]() { return !running; })) {
+			lock.unlock();
+
+			Timestamps current = scan();
+			std::vector<std::string> changed;
+			bool includeChanged = false;
+			for (const auto& [name, time] : current) {
+				auto it = timestamps.find(name);
+				if (it != timestamps.end() && it->second == time) {
+					continue;
+				}
+				if (std::filesystem::path(name).extension() == ".glsl") {
+					includeChanged = true;
+				}
+				else {
+					changed.push_back(name);
+				}
+			}
+			if (includeChanged) {
+				changed = sources;
+			}
+			timestamps = std::move(current);
+
+			if (!changed.empty()) {
+				bool compiled = true;
+				for (const auto& name : changed) {
+					compiled = compile(name) && compiled;
+				}
+				if (compiled) {
+					onCompiled();
+				}
+				else {
+					// Retried on the next save
+					std::cerr << "Shader compilation failed, keeping the current pipeline\n";
+				}
+			}
+
+			lock.lock();
+		}
+	}
+
+	bool compile(const std::string& name) const {
+		std::cout << "Compile shader: " << name << "\n";
+
+		std::string path = sourceDir + name;
+		std::string command = "\"" + compiler + "\" -c \"" + path + "\" -o \"" + path +
+			".spv\" --target-env=vulkan1.2";
+#ifdef _WIN32
+		// cmd.exe strips the outer pair of quotes
+		command = "\"" + command + "\"";
+#endif
+		return std::system(command.c_str()) == 0;
+	}
+
+#ifdef GLSLC_EXECUTABLE
+	std::string compiler = GLSLC_EXECUTABLE;
+#else
+	std::string compiler = "glslc";
+#endif
+	std::string sourceDir;
+	std::vector<std::string> sources;
+	std::function<void()> onCompiled;
+	std::chrono::milliseconds interval{ 250 };
+	Timestamps timestamps;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	bool running = false;
+};
@@ -0,0 +1,193 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing job system. Every thread has its own queue: it runs its
+// newest job first and, when the queue is empty, steals the oldest job of
+// another thread. The thread that created the system is thread 0 and helps
+// out while it waits on a group. Other threads, e.g. the shader watcher, may
+// start and wait on jobs too; they queue on thread 0 and wait without
+// running jobs, so per-thread resources are never shared.
+class JobSystem {
+public:
+	// Jobs started with run() on the same group can be waited on together
+	class Group {
+	public:
+		bool isDone() const { return remaining.load(std::memory_order_acquire) == 0; }
+
+	private:
+		friend class JobSystem;
+		std::atomic<uint32_t> remaining{ 0 };
+	};
+
+	~JobSystem() { shutdown(); }
+
+	// 0 workers uses every hardware thread besides the calling one
+	void init(uint32_t workerCount = 0) {
+		if (workerCount == 0) {
+			workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+		}
+		std::cout << "Create job system: " << workerCount << " workers\n";
+
+		queues.resize(workerCount + 1);
+		for (auto& queue : queues) {
+			queue = std::make_unique<Queue>();
+		}
+		threadIndex = 0;
+		isMember = true;
+		running = true;
+		for (uint32_t i = 1; i <= workerCount; i++) {
+			workers.emplace_back([this, i]() { workerLoop(i); });
+		}
+	}
+
+	void shutdown() {
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			running = false;
+		}
+		wakeup.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+		queues.clear();
+	}
+
+	// Workers plus the thread that created the system
+	uint32_t getThreadCount() const { return static_cast<uint32_t>(queues.size()); }
+
+	// Index of the calling thread in [0, getThreadCount()), for per-thread
+	// resources such as command pools
+	static uint32_t getThreadIndex() { return threadIndex; }
+
+	void run(Group& group, std::function<void()> job) {
+		group.remaining.fetch_add(1, std::memory_order_relaxed);
+		{
+			// Counted before it is queued, so pending never underflows, and
+			// under the sleep mutex, so a worker about to sleep sees it
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			pending.fetch_add(1, std::memory_order_release);
+		}
+		Queue& queue = *queues[threadIndex];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back({ std::move(job), &group });
+		}
+		wakeup.notify_one();
+	}
+
+	// Runs queued jobs on the calling thread until the group has finished
+	void wait(Group& group) {
+		while (!group.isDone()) {
+			if (!isMember || !runOne(threadIndex)) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	// Runs func(i) for i in [0, count) on up to every thread, the calling
+	// one included. Runs serially before init().
+	void parallelFor(size_t count, const std::function<void(size_t)>& func) {
+		size_t jobCount = std::min<size_t>(getThreadCount(), count);
+		std::atomic<size_t> next{ 0 };
+		auto body = [&]() {
+			for (size_t i = next++; i < count; i = next++) {
+				func(i);
+			}
+		};
+		if (jobCount <= 1) {
+			body();
+			return;
+		}
+
+		Group group;
+		for (size_t j = 1; j < jobCount; j++) {
+			run(group, body);
+		}
+		body();
+		wait(group);
+	}
+
+private:
+	struct Job {
+		std::function<void()> function;
+		Group* group = nullptr;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	bool runOne(uint32_t self) {
+		Job job;
+		if (!pop(self, job)) {
+			return false;
+		}
+		job.function();
+		job.group->remaining.fetch_sub(1, std::memory_order_acq_rel);
+		return true;
+	}
+
+	// Own queue from the back, then the other queues from the front
+	bool pop(uint32_t self, Job& job) {
+		if (pending.load(std::memory_order_acquire) == 0) {
+			return false;
+		}
+		uint32_t count = static_cast<uint32_t>(queues.size());
+		for (uint32_t i = 0; i < count; i++) {
+			Queue& queue = *queues[(self + i) % count];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.jobs.empty()) {
+				continue;
+			}
+			if (i == 0) {
+				job = std::move(queue.jobs.back());
+				queue.jobs.pop_back();
+			}
+			else {
+				job = std::move(queue.jobs.front());
+				queue.jobs.pop_front();
+			}
+			pending.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	void workerLoop(uint32_t index) {
+		threadIndex = index;
+		isMember = true;
+		while (true) {
+			if (runOne(index)) {
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wakeup.wait(lock, [this]() {
+				return !running || pending.load(std::memory_order_acquire) > 0;
+			});
+			if (!running) {
+				return;
+			}
+		}
+	}
+
+	static inline thread_local uint32_t threadIndex = 0;
+	static inline thread_local bool isMember = false;  // creating thread or worker
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<uint32_t> pending{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wakeup;
+	bool running = false;
+};
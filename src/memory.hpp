@@ -0,0 +1,384 @@
+#pragma once
+#include "vkutils.hpp"
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+class MemoryAllocator;
+
+// One vkAllocateMemory result. Buffers are carved out of it by first-fit
+// over a coalesced free list.
+struct MemoryBlock {
+	vk::UniqueDeviceMemory memory;
+	vk::DeviceSize size = 0;
+	vk::DeviceSize used = 0;
+	uint32_t memoryType = 0;
+	uint32_t allocationCount = 0;
+	bool dedicated = false;
+	void* mapped = nullptr;
+
+	// offset -> size
+	std::map<vk::DeviceSize, vk::DeviceSize> freeRanges;
+};
+
+// Move-only handle to a range inside a MemoryBlock, returned to the
+// allocator on destruction.
+struct Allocation {
+	MemoryAllocator* allocator = nullptr;
+	MemoryBlock* block = nullptr;
+	vk::DeviceSize offset = 0;
+	vk::DeviceSize size = 0;
+
+	Allocation() = default;
+	Allocation(const Allocation&) = delete;
+	Allocation& operator=(const Allocation&) = delete;
+	Allocation(Allocation&& other) noexcept { *this = std::move(other); }
+	Allocation& operator=(Allocation&& other) noexcept {
+		if (this != &other) {
+			free();
+			allocator = std::exchange(other.allocator, nullptr);
+			block = std::exchange(other.block, nullptr);
+			offset = std::exchange(other.offset, 0);
+			size = std::exchange(other.size, 0);
+		}
+		return *this;
+	}
+	~Allocation() { free(); }
+
+	vk::DeviceMemory memory() const {
+		return block ? *block->memory : vk::DeviceMemory{};
+	}
+
+	void* mapped() const {
+		if (!block || !block->mapped) {
+			return nullptr;
+		}
+		return static_cast<uint8_t*>(block->mapped) + offset;
+	}
+
+	void free();
+};
+
+struct MemoryStats {
+	uint32_t blockCount = 0;
+	uint32_t allocationCount = 0;
+	vk::DeviceSize bytesReserved = 0;
+	vk::DeviceSize bytesUsed = 0;
+	vk::DeviceSize bytesFree = 0;
+	vk::DeviceSize largestFreeRange = 0;
+
+	// 0 when all free space is one contiguous range, approaching 1 as it
+	// splinters into many small ranges.
+	float fragmentation() const {
+		if (bytesFree == 0) {
+			return 0.0f;
+		}
+		return 1.0f - static_cast<float>(largestFreeRange) / static_cast<float>(bytesFree);
+	}
+};
+
+class MemoryAllocator {
+public:
+	static constexpr vk::DeviceSize defaultBlockSize = 64ull << 20;
+
+	MemoryAllocator() = default;
+	MemoryAllocator(const MemoryAllocator&) = delete;
+	MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+	void init(vk::PhysicalDevice physicalDevice, vk::Device device,
+		vk::DeviceSize blockSize = defaultBlockSize) {
+		this->physicalDevice = physicalDevice;
+		this->device = device;
+		this->blockSize = blockSize;
+		bufferImageGranularity =
+			physicalDevice.getProperties().limits.bufferImageGranularity;
+	}
+
+	vk::Device getDevice() const { return device; }
+	vk::PhysicalDevice getPhysicalDevice() const { return physicalDevice; }
+
+	// Buffers are created shared between these queue families, so they can
+	// be written and read on different queues without ownership transfers.
+	// Images stay exclusive, their layouts and compression depend on it.
+	void setSharedQueueFamilies(const std::vector<uint32_t>& families) {
+		sharedQueueFamilies = families;
+	}
+	const std::vector<uint32_t>& getSharedQueueFamilies() const { return sharedQueueFamilies; }
+
+	// linear is false for optimal-tiling images, which must not share a
+	// bufferImageGranularity page with buffers.
+	Allocation allocate(vk::MemoryRequirements requirements,
+		vk::MemoryPropertyFlags memoryProperty,
+		bool linear = true) {
+		uint32_t memoryType = vkutils::getMemoryType(physicalDevice,
+			requirements, memoryProperty);
+
+		vk::DeviceSize alignment = requirements.alignment;
+		vk::DeviceSize size = requirements.size;
+		if (!linear) {
+			alignment = std::max(alignment, bufferImageGranularity);
+			size = vkutils::alignUp(size, bufferImageGranularity);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Allocation allocation{};
+		allocation.allocator = this;
+		allocation.size = size;
+
+		// Large requests get their own block so they do not pin a shared one
+		if (size > blockSize / 2) {
+			MemoryBlock* block = createBlock(memoryType, size, true);
+			allocation.block = block;
+			allocation.offset = 0;
+			block->freeRanges.clear();
+			block->used = size;
+			block->allocationCount++;
+			return allocation;
+		}
+
+		for (auto& block : blocks[memoryType]) {
+			if (block->dedicated) {
+				continue;
+			}
+			if (auto offset = suballocate(*block, size, alignment)) {
+				allocation.block = block.get();
+				allocation.offset = *offset;
+				return allocation;
+			}
+		}
+
+		MemoryBlock* block = createBlock(memoryType, blockSize, false);
+		allocation.block = block;
+		allocation.offset = *suballocate(*block, size, alignment);
+		return allocation;
+	}
+
+	MemoryStats getStats() const {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		MemoryStats stats{};
+		for (const auto& typeBlocks : blocks) {
+			for (const auto& block : typeBlocks) {
+				stats.blockCount++;
+				stats.allocationCount += block->allocationCount;
+				stats.bytesReserved += block->size;
+				stats.bytesUsed += block->used;
+				for (const auto& [offset, size] : block->freeRanges) {
+					stats.bytesFree += size;
+					stats.largestFreeRange = std::max(stats.largestFreeRange, size);
+				}
+			}
+		}
+		return stats;
+	}
+
+	void printStats() const {
+		MemoryStats stats = getStats();
+		std::cout << "Device memory: "
+			<< stats.blockCount << " blocks, "
+			<< stats.allocationCount << " allocations, "
+			<< stats.bytesUsed / 1024 << " / " << stats.bytesReserved / 1024 << " KiB used, "
+			<< "fragmentation " << stats.fragmentation() << "\n";
+	}
+
+private:
+	friend struct Allocation;
+
+	vk::PhysicalDevice physicalDevice;
+	vk::Device device;
+	vk::DeviceSize blockSize = defaultBlockSize;
+	vk::DeviceSize bufferImageGranularity = 1;
+	std::vector<uint32_t> sharedQueueFamilies;
+
+	std::array<std::vector<std::unique_ptr<MemoryBlock>>, VK_MAX_MEMORY_TYPES> blocks;
+	mutable std::mutex mutex;
+
+	MemoryBlock* createBlock(uint32_t memoryType, vk::DeviceSize size, bool dedicated) {
+		// Every block may back buffers that need a device address
+		vk::MemoryAllocateFlagsInfo allocateFlags{};
+		allocateFlags.setFlags(vk::MemoryAllocateFlagBits::eDeviceAddress);
+
+		vk::MemoryAllocateInfo allocateInfo{};
+		allocateInfo.setAllocationSize(size);
+		allocateInfo.setMemoryTypeIndex(memoryType);
+		allocateInfo.setPNext(&allocateFlags);
+
+		auto block = std::make_unique<MemoryBlock>();
+		block->memory = device.allocateMemoryUnique(allocateInfo);
+		block->size = size;
+		block->memoryType = memoryType;
+		block->dedicated = dedicated;
+		block->freeRanges.emplace(0, size);
+
+		// Host visible blocks stay mapped for their whole lifetime, since a
+		// VkDeviceMemory cannot be mapped twice by different sub-allocations.
+		auto memoryProperties = physicalDevice.getMemoryProperties();
+		if (memoryProperties.memoryTypes[memoryType].propertyFlags &
+			vk::MemoryPropertyFlagBits::eHostVisible) {
+			block->mapped = device.mapMemory(*block->memory, 0, size);
+		}
+
+		blocks[memoryType].push_back(std::move(block));
+		return blocks[memoryType].back().get();
+	}
+
+	std::optional<vk::DeviceSize> suballocate(MemoryBlock& block,
+		vk::DeviceSize size, vk::DeviceSize alignment) {
+		for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+			auto [rangeOffset, rangeSize] = *it;
+			vk::DeviceSize offset = vkutils::alignUp(rangeOffset, alignment);
+			if (offset + size > rangeOffset + rangeSize) {
+				continue;
+			}
+
+			block.freeRanges.erase(it);
+			if (offset > rangeOffset) {
+				block.freeRanges.emplace(rangeOffset, offset - rangeOffset);
+			}
+			vk::DeviceSize tail = rangeOffset + rangeSize - (offset + size);
+			if (tail > 0) {
+				block.freeRanges.emplace(offset + size, tail);
+			}
+
+			block.used += size;
+			block.allocationCount++;
+			return offset;
+		}
+		return std::nullopt;
+	}
+
+	void release(MemoryBlock* block, vk::DeviceSize offset, vk::DeviceSize size) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		block->used -= size;
+		block->allocationCount--;
+
+		// Insert and merge with the neighbouring free ranges
+		auto next = block->freeRanges.lower_bound(offset);
+		if (next != block->freeRanges.end() && offset + size == next->first) {
+			size += next->second;
+			next = block->freeRanges.erase(next);
+		}
+		if (next != block->freeRanges.begin()) {
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == offset) {
+				offset = prev->first;
+				size += prev->second;
+				block->freeRanges.erase(prev);
+			}
+		}
+		block->freeRanges.emplace(offset, size);
+
+		if (block->allocationCount > 0) {
+			return;
+		}
+
+		// Keep one empty shared block per memory type around for reuse
+		auto& typeBlocks = blocks[block->memoryType];
+		if (!block->dedicated) {
+			size_t sharedCount = std::count_if(typeBlocks.begin(), typeBlocks.end(),
+				[](const auto& b) { return !b->dedicated; });
+			if (sharedCount == 1) {
+				return;
+			}
+		}
+		typeBlocks.erase(std::find_if(typeBlocks.begin(), typeBlocks.end(),
+			[&](const auto& b) { return b.get() == block; }));
+	}
+};
+
+inline void Allocation::free() {
+	if (allocator && block) {
+		allocator->release(block, offset, size);
+	}
+	allocator = nullptr;
+	block = nullptr;
+	offset = 0;
+	size = 0;
+}
+
+struct Buffer {
+	vk::UniqueBuffer buffer;
+	Allocation allocation;
+	vk::DeviceAddress address;
+
+	void init(MemoryAllocator& allocator,
+		vk::Device device,
+		vk::DeviceSize size,
+		vk::BufferUsageFlags usage,
+		vk::MemoryPropertyFlags memoryProperty,
+		const void* data = nullptr) {
+		// create buffer
+		vk::BufferCreateInfo createInfo{};
+		createInfo.setSize(size);
+		createInfo.setUsage(usage);
+		if (allocator.getSharedQueueFamilies().size() > 1) {
+			createInfo.setSharingMode(vk::SharingMode::eConcurrent);
+			createInfo.setQueueFamilyIndices(allocator.getSharedQueueFamilies());
+		}
+		buffer = device.createBufferUnique(createInfo);
+
+		//Allocate memory
+		vk::MemoryRequirements memoryReq =
+			device.getBufferMemoryRequirements(*buffer);
+		allocation = allocator.allocate(memoryReq, memoryProperty);
+
+		device.bindBufferMemory(*buffer, allocation.memory(), allocation.offset);
+
+		if (data) {
+			// Device-local buffers are filled through StagingRing
+			if (!allocation.mapped()) {
+				std::cerr << "Initial data needs host-visible memory\n";
+				std::abort();
+			}
+			memcpy(allocation.mapped(), data, size);
+		}
+
+		if (usage & vk::BufferUsageFlagBits::eShaderDeviceAddress) {
+			vk::BufferDeviceAddressInfo addressInfo{};
+			addressInfo.setBuffer(*buffer);
+			address = device.getBufferAddressKHR(&addressInfo);
+		}
+	}
+};
+
+struct Image {
+	vk::UniqueImage image;
+	vk::UniqueImageView view;
+	Allocation allocation;
+
+	void init(MemoryAllocator& allocator,
+		vk::Device device,
+		vk::Extent2D extent,
+		vk::Format format,
+		vk::ImageUsageFlags usage) {
+		vk::ImageCreateInfo createInfo{};
+		createInfo.setImageType(vk::ImageType::e2D);
+		createInfo.setFormat(format);
+		createInfo.setExtent({ extent.width, extent.height, 1 });
+		createInfo.setMipLevels(1);
+		createInfo.setArrayLayers(1);
+		createInfo.setSamples(vk::SampleCountFlagBits::e1);
+		createInfo.setTiling(vk::ImageTiling::eOptimal);
+		createInfo.setUsage(usage);
+		createInfo.setInitialLayout(vk::ImageLayout::eUndefined);
+		image = device.createImageUnique(createInfo);
+
+		vk::MemoryRequirements memoryReq =
+			device.getImageMemoryRequirements(*image);
+		allocation = allocator.allocate(memoryReq,
+			vk::MemoryPropertyFlagBits::eDeviceLocal, false);
+
+		device.bindImageMemory(*image, allocation.memory(), allocation.offset);
+
+		vk::ImageViewCreateInfo viewCreateInfo{};
+		viewCreateInfo.setImage(*image);
+		viewCreateInfo.setViewType(vk::ImageViewType::e2D);
+		viewCreateInfo.setFormat(format);
+		viewCreateInfo.setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+		view = device.createImageViewUnique(viewCreateInfo);
+	}
+};
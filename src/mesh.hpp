@@ -0,0 +1,817 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <stb_image.h>
+#include "jobs.hpp"
+
+// Position first, BLAS builds read it with a stride of sizeof(Vertex)
+struct Vertex {
+	float pose[3];
+	float normal[3];
+	float uv[2];
+};
+
+struct Material {
+	float baseColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	float emissive[3] = { 0.0f, 0.0f, 0.0f };
+	float roughness = 1.0f;
+	float metallic = 0.0f;
+	int32_t baseColorTexture = -1;  // index into Scene::textures
+};
+
+// Decoded RGBA8 image
+struct Texture {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint8_t> pixels;
+};
+
+struct Mesh {
+	std::string name;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	uint32_t material = 0;
+};
+
+// Row-major 3x4, the layout of VkTransformMatrixKHR
+using Transform = std::array<std::array<float, 4>, 3>;
+
+inline constexpr Transform identityTransform = { {
+	{ 1.0f, 0.0f, 0.0f, 0.0f },
+	{ 0.0f, 1.0f, 0.0f, 0.0f },
+	{ 0.0f, 0.0f, 1.0f, 0.0f },
+} };
+
+// One placement of a mesh, becomes one TLAS instance
+struct SceneNode {
+	uint32_t mesh = 0;
+	Transform transform = identityTransform;
+};
+
+// materials[0] is the default material
+struct Scene {
+	std::vector<Mesh> meshes;
+	std::vector<SceneNode> nodes;
+	std::vector<Material> materials{ Material{} };
+	std::vector<Texture> textures;
+};
+
+namespace meshloader {
+	inline std::vector<char> readFile(const std::string& filename) {
+		std::ifstream file(filename, std::ios::ate | std::ios::binary);
+		if (!file.is_open()) {
+			std::cerr << "Failed to open mesh file: " << filename << "\n";
+			std::abort();
+		}
+
+		size_t fileSize = file.tellg();
+		std::vector<char> buffer(fileSize);
+		file.seekg(0);
+		file.read(buffer.data(), fileSize);
+		return buffer;
+	}
+
+	// Area weighted vertex normals for vertices that have none
+	inline void fillMissingNormals(Mesh& mesh) {
+		auto isMissing = [](const Vertex& v) {
+			return v.normal[0] == 0.0f && v.normal[1] == 0.0f && v.normal[2] == 0.0f;
+		};
+		if (std::none_of(mesh.vertices.begin(), mesh.vertices.end(), isMissing)) {
+			return;
+		}
+		for (uint32_t index : mesh.indices) {
+			if (index >= mesh.vertices.size()) {
+				std::cerr << "Vertex index " << index << " out of range (" << mesh.vertices.size() << " vertices)\n";
+				std::abort();
+			}
+		}
+
+		std::vector<std::array<float, 3>> normals(mesh.vertices.size(), { 0.0f, 0.0f, 0.0f });
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+			const float* p0 = mesh.vertices[mesh.indices[i]].pose;
+			const float* p1 = mesh.vertices[mesh.indices[i + 1]].pose;
+			const float* p2 = mesh.vertices[mesh.indices[i + 2]].pose;
+			float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float n[3] = {
+				e1[1] * e2[2] - e1[2] * e2[1],
+				e1[2] * e2[0] - e1[0] * e2[2],
+				e1[0] * e2[1] - e1[1] * e2[0],
+			};
+			for (size_t k = 0; k < 3; k++) {
+				for (int c = 0; c < 3; c++) {
+					normals[mesh.indices[i + k]][c] += n[c];
+				}
+			}
+		}
+
+		for (size_t v = 0; v < mesh.vertices.size(); v++) {
+			if (!isMissing(mesh.vertices[v])) {
+				continue;
+			}
+			auto& n = normals[v];
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (length > 0.0f) {
+				for (int c = 0; c < 3; c++) {
+					mesh.vertices[v].normal[c] = n[c] / length;
+				}
+			}
+		}
+	}
+
+	inline Texture decodeImage(const stbi_uc* data, size_t size, const std::string& name) {
+		int width = 0, height = 0, channels = 0;
+		stbi_uc* pixels = stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &channels, 4);
+		if (!pixels) {
+			std::cerr << "Failed to decode image " << name << ": " << stbi_failure_reason() << "\n";
+			return {};
+		}
+
+		Texture texture{};
+		texture.width = static_cast<uint32_t>(width);
+		texture.height = static_cast<uint32_t>(height);
+		texture.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+		stbi_image_free(pixels);
+		return texture;
+	}
+
+	// ---------------------------------------------------------------- OBJ
+
+	// One face corner, indices into the global v / vt / vn arrays
+	struct ObjCorner {
+		uint32_t position;
+		uint32_t uv;
+		uint32_t normal;
+
+		bool operator==(const ObjCorner&) const = default;
+	};
+
+	struct ObjCornerHash {
+		size_t operator()(const ObjCorner& c) const {
+			uint64_t h = c.position * 0x9E3779B97F4A7C15ull;
+			h ^= (c.uv + 0x632BE59BD9B4E019ull) + (h << 6) + (h >> 2);
+			h ^= (c.normal + 0x85157AF5ull) + (h << 6) + (h >> 2);
+			return static_cast<size_t>(h);
+		}
+	};
+
+	constexpr uint32_t objNone = UINT32_MAX;
+
+	// Lines of one slice of an OBJ file. Slices are parsed in parallel; the
+	// first pass counts the v / vt / vn lines before each slice and finds
+	// which object is active at its start, so the second pass can resolve
+	// relative face indices.
+	struct ObjSlice {
+		size_t begin = 0;
+		size_t end = 0;
+
+		// First pass
+		std::array<uint32_t, 3> counts{};  // v, vt, vn
+		std::string lastObject;
+		bool hasObject = false;
+
+		// Second pass
+		std::vector<float> positions;
+		std::vector<float> uvs;
+		std::vector<float> normals;
+		std::vector<std::pair<std::string, std::vector<ObjCorner>>> groups;
+	};
+
+	inline std::string_view nextToken(std::string_view& line) {
+		size_t begin = line.find_first_not_of(" \t\r");
+		if (begin == std::string_view::npos) {
+			line = {};
+			return {};
+		}
+		size_t end = line.find_first_of(" \t\r", begin);
+		if (end == std::string_view::npos) {
+			end = line.size();
+		}
+		std::string_view token = line.substr(begin, end - begin);
+		line.remove_prefix(end);
+		return token;
+	}
+
+	template <typename Func>
+	inline void forEachLine(const std::vector<char>& data, size_t begin, size_t end, Func func) {
+		while (begin < end) {
+			const char* lineBegin = data.data() + begin;
+			const void* newline = std::memchr(lineBegin, '\n', end - begin);
+			size_t lineEnd = newline
+				? static_cast<const char*>(newline) - data.data()
+				: end;
+			func(std::string_view(lineBegin, lineEnd - begin));
+			begin = lineEnd + 1;
+		}
+	}
+
+	inline std::string objectName(std::string_view line) {
+		nextToken(line);
+		size_t begin = line.find_first_not_of(" \t");
+		size_t end = line.find_last_not_of(" \t\r");
+		if (begin == std::string_view::npos) {
+			return {};
+		}
+		return std::string(line.substr(begin, end - begin + 1));
+	}
+
+	inline void parseFloats(std::string_view& rest, int count, std::vector<float>& out) {
+		for (int i = 0; i < count; i++) {
+			std::string_view token = nextToken(rest);
+			float value = 0.0f;
+			std::from_chars(token.data(), token.data() + token.size(), value);
+			out.push_back(value);
+		}
+	}
+
+	// Resolves a 1-based or negative (relative) OBJ index, objNone if absent
+	inline uint32_t resolveIndex(std::string_view token, uint32_t countSoFar) {
+		if (token.empty()) {
+			return objNone;
+		}
+		int64_t index = 0;
+		std::from_chars(token.data(), token.data() + token.size(), index);
+		if (index == 0) {
+			return objNone;
+		}
+		return static_cast<uint32_t>(index > 0 ? index - 1 : countSoFar + index);
+	}
+
+	inline Scene loadObj(const std::string& filename, JobSystem& jobs) {
+		std::vector<char> data = readFile(filename);
+
+		// Cut the file into slices that end at line breaks
+		size_t sliceCount = std::max(jobs.getThreadCount(), 1u);
+		size_t sliceSize = std::max<size_t>(data.size() / sliceCount, 1);
+		std::vector<ObjSlice> slices;
+		for (size_t begin = 0; begin < data.size();) {
+			size_t end = std::min(begin + sliceSize, data.size());
+			while (end < data.size() && data[end - 1] != '\n') {
+				end++;
+			}
+			ObjSlice& slice = slices.emplace_back();
+			slice.begin = begin;
+			slice.end = end;
+			begin = end;
+		}
+
+		jobs.parallelFor(slices.size(), [&](size_t s) {
+			ObjSlice& slice = slices[s];
+			forEachLine(data, slice.begin, slice.end, [&](std::string_view line) {
+				std::string_view rest = line;
+				std::string_view keyword = nextToken(rest);
+				if (keyword == "v") {
+					slice.counts[0]++;
+				}
+				else if (keyword == "vt") {
+					slice.counts[1]++;
+				}
+				else if (keyword == "vn") {
+					slice.counts[2]++;
+				}
+				else if (keyword == "o" || keyword == "g") {
+					slice.lastObject = objectName(line);
+					slice.hasObject = true;
+				}
+			});
+		});
+
+		std::vector<std::array<uint32_t, 3>> bases(slices.size());
+		std::vector<std::string> startObjects(slices.size());
+		std::array<uint32_t, 3> totals{};
+		std::string currentObject;
+		for (size_t s = 0; s < slices.size(); s++) {
+			bases[s] = totals;
+			startObjects[s] = currentObject;
+			for (int k = 0; k < 3; k++) {
+				totals[k] += slices[s].counts[k];
+			}
+			if (slices[s].hasObject) {
+				currentObject = slices[s].lastObject;
+			}
+		}
+
+		jobs.parallelFor(slices.size(), [&](size_t s) {
+			ObjSlice& slice = slices[s];
+			slice.positions.reserve(slice.counts[0] * 3);
+			slice.uvs.reserve(slice.counts[1] * 2);
+			slice.normals.reserve(slice.counts[2] * 3);
+			slice.groups.emplace_back(startObjects[s], std::vector<ObjCorner>{});
+
+			std::vector<ObjCorner> polygon;
+			forEachLine(data, slice.begin, slice.end, [&](std::string_view line) {
+				std::string_view rest = line;
+				std::string_view keyword = nextToken(rest);
+				if (keyword == "v") {
+					parseFloats(rest, 3, slice.positions);
+				}
+				else if (keyword == "vt") {
+					parseFloats(rest, 2, slice.uvs);
+				}
+				else if (keyword == "vn") {
+					parseFloats(rest, 3, slice.normals);
+				}
+				else if (keyword == "o" || keyword == "g") {
+					slice.groups.emplace_back(objectName(line), std::vector<ObjCorner>{});
+				}
+				else if (keyword == "f") {
+					// v, v/vt, v//vn or v/vt/vn
+					polygon.clear();
+					std::array<uint32_t, 3> soFar = {
+						bases[s][0] + static_cast<uint32_t>(slice.positions.size() / 3),
+						bases[s][1] + static_cast<uint32_t>(slice.uvs.size() / 2),
+						bases[s][2] + static_cast<uint32_t>(slice.normals.size() / 3),
+					};
+					for (std::string_view token = nextToken(rest); !token.empty(); token = nextToken(rest)) {
+						std::array<std::string_view, 3> parts;
+						for (int k = 0; k < 3 && !token.empty(); k++) {
+							size_t slash = token.find('/');
+							parts[k] = token.substr(0, slash);
+							token = slash == std::string_view::npos ? std::string_view{} : token.substr(slash + 1);
+						}
+						polygon.push_back({
+							resolveIndex(parts[0], soFar[0]),
+							resolveIndex(parts[1], soFar[1]),
+							resolveIndex(parts[2], soFar[2]) });
+					}
+					auto& corners = slice.groups.back().second;
+					for (size_t i = 2; i < polygon.size(); i++) {
+						corners.push_back(polygon[0]);
+						corners.push_back(polygon[i - 1]);
+						corners.push_back(polygon[i]);
+					}
+				}
+			});
+		});
+
+		std::vector<float> positions;
+		std::vector<float> uvs;
+		std::vector<float> normals;
+		positions.reserve(static_cast<size_t>(totals[0]) * 3);
+		uvs.reserve(static_cast<size_t>(totals[1]) * 2);
+		normals.reserve(static_cast<size_t>(totals[2]) * 3);
+		for (const auto& slice : slices) {
+			positions.insert(positions.end(), slice.positions.begin(), slice.positions.end());
+			uvs.insert(uvs.end(), slice.uvs.begin(), slice.uvs.end());
+			normals.insert(normals.end(), slice.normals.begin(), slice.normals.end());
+		}
+
+		// Merge groups of the same object, in order of first appearance
+		Scene scene;
+		std::vector<std::vector<ObjCorner>> meshCorners;
+		std::unordered_map<std::string, uint32_t> meshIndices;
+		for (auto& slice : slices) {
+			for (auto& [name, corners] : slice.groups) {
+				if (corners.empty()) {
+					continue;
+				}
+				auto [it, inserted] = meshIndices.emplace(name, static_cast<uint32_t>(scene.meshes.size()));
+				if (inserted) {
+					scene.meshes.push_back({ name, {}, {}, 0 });
+					meshCorners.emplace_back();
+				}
+				auto& dst = meshCorners[it->second];
+				dst.insert(dst.end(), corners.begin(), corners.end());
+			}
+		}
+
+		// Give every mesh its own vertex array with one vertex per unique corner
+		jobs.parallelFor(scene.meshes.size(), [&](size_t m) {
+			Mesh& mesh = scene.meshes[m];
+			std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> localIndices;
+			mesh.indices.reserve(meshCorners[m].size());
+			for (const ObjCorner& corner : meshCorners[m]) {
+				if (corner.position >= totals[0]) {
+					std::cerr << "Invalid face index in " << filename << "\n";
+					std::abort();
+				}
+				auto [it, inserted] = localIndices.emplace(corner,
+					static_cast<uint32_t>(mesh.vertices.size()));
+				if (inserted) {
+					Vertex vertex{};
+					std::memcpy(vertex.pose, &positions[static_cast<size_t>(corner.position) * 3], sizeof(vertex.pose));
+					if (corner.normal < totals[2]) {
+						std::memcpy(vertex.normal, &normals[static_cast<size_t>(corner.normal) * 3], sizeof(vertex.normal));
+					}
+					if (corner.uv < totals[1]) {
+						std::memcpy(vertex.uv, &uvs[static_cast<size_t>(corner.uv) * 2], sizeof(vertex.uv));
+					}
+					mesh.vertices.push_back(vertex);
+				}
+				mesh.indices.push_back(it->second);
+			}
+			fillMissingNormals(mesh);
+		});
+
+		for (uint32_t m = 0; m < scene.meshes.size(); m++) {
+			scene.nodes.push_back({ m, identityTransform });
+		}
+		return scene;
+	}
+
+	// ---------------------------------------------------------------- glTF
+
+	// Column-major 4x4 as stored by glTF
+	using Matrix4 = std::array<float, 16>;
+
+	inline constexpr Matrix4 identityMatrix = {
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f,
+	};
+
+	inline Matrix4 multiply(const Matrix4& a, const Matrix4& b) {
+		Matrix4 result{};
+		for (int col = 0; col < 4; col++) {
+			for (int row = 0; row < 4; row++) {
+				float sum = 0.0f;
+				for (int k = 0; k < 4; k++) {
+					sum += a[k * 4 + row] * b[col * 4 + k];
+				}
+				result[col * 4 + row] = sum;
+			}
+		}
+		return result;
+	}
+
+	inline Matrix4 nodeMatrix(const nlohmann::json& node) {
+		if (node.contains("matrix")) {
+			return node["matrix"].get<Matrix4>();
+		}
+
+		std::array<float, 3> t = node.value("translation", std::array<float, 3>{ 0.0f, 0.0f, 0.0f });
+		std::array<float, 4> q = node.value("rotation", std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 1.0f });
+		std::array<float, 3> s = node.value("scale", std::array<float, 3>{ 1.0f, 1.0f, 1.0f });
+		float x = q[0], y = q[1], z = q[2], w = q[3];
+
+		// T * R * S
+		return {
+			(1.0f - 2.0f * (y * y + z * z)) * s[0], (2.0f * (x * y + z * w)) * s[0], (2.0f * (x * z - y * w)) * s[0], 0.0f,
+			(2.0f * (x * y - z * w)) * s[1], (1.0f - 2.0f * (x * x + z * z)) * s[1], (2.0f * (y * z + x * w)) * s[1], 0.0f,
+			(2.0f * (x * z + y * w)) * s[2], (2.0f * (y * z - x * w)) * s[2], (1.0f - 2.0f * (x * x + y * y)) * s[2], 0.0f,
+			t[0], t[1], t[2], 1.0f,
+		};
+	}
+
+	inline Transform toTransform(const Matrix4& m) {
+		Transform transform{};
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 4; col++) {
+				transform[row][col] = m[col * 4 + row];
+			}
+		}
+		return transform;
+	}
+
+	inline Scene loadGlb(const std::string& filename, JobSystem& jobs) {
+		std::vector<char> data = readFile(filename);
+
+		auto readU32 = [&](size_t offset) {
+			uint32_t value = 0;
+			if (offset + 4 <= data.size()) {
+				std::memcpy(&value, data.data() + offset, 4);
+			}
+			return value;
+		};
+
+		constexpr uint32_t glbMagic = 0x46546C67;      // "glTF"
+		constexpr uint32_t jsonChunkType = 0x4E4F534A; // "JSON"
+		constexpr uint32_t binChunkType = 0x004E4942;  // "BIN\0"
+		if (readU32(0) != glbMagic || readU32(4) != 2) {
+			std::cerr << "Not a glTF 2.0 binary file: " << filename << "\n";
+			std::abort();
+		}
+
+		std::string_view jsonChunk;
+		std::string_view binChunk;
+		for (size_t offset = 12; offset + 8 <= data.size();) {
+			uint32_t chunkLength = readU32(offset);
+			uint32_t chunkType = readU32(offset + 4);
+			if (offset + 8 + chunkLength > data.size()) {
+				break;
+			}
+			std::string_view chunk(data.data() + offset + 8, chunkLength);
+			if (chunkType == jsonChunkType) {
+				jsonChunk = chunk;
+			}
+			else if (chunkType == binChunkType) {
+				binChunk = chunk;
+			}
+			offset += 8 + chunkLength;
+		}
+
+		const nlohmann::json gltf = nlohmann::json::parse(jsonChunk.begin(), jsonChunk.end());
+
+		// Bytes of a buffer view inside the BIN chunk
+		auto getBufferView = [&](size_t index) {
+			const nlohmann::json& bufferView = gltf.at("bufferViews").at(index);
+			if (bufferView.value("buffer", 0) != 0) {
+				std::cerr << "Only the embedded GLB buffer is supported: " << filename << "\n";
+				std::abort();
+			}
+			size_t offset = bufferView.value("byteOffset", size_t(0));
+			size_t length = bufferView.at("byteLength").get<size_t>();
+			if (offset + length > binChunk.size()) {
+				std::cerr << "glTF buffer view out of range in " << filename << "\n";
+				std::abort();
+			}
+			return std::string_view(binChunk.data() + offset, length);
+		};
+
+		// Elements of an accessor inside the BIN chunk
+		struct AccessorView {
+			const char* data = nullptr;
+			size_t stride = 0;
+			size_t count = 0;
+			uint32_t componentType = 0;
+		};
+
+		auto getAccessor = [&](size_t index, size_t elementSize) {
+			const nlohmann::json& accessor = gltf.at("accessors").at(index);
+			if (!accessor.contains("bufferView") || accessor.contains("sparse")) {
+				std::cerr << "Unsupported glTF accessor in " << filename << "\n";
+				std::abort();
+			}
+			size_t viewIndex = accessor["bufferView"].get<size_t>();
+			std::string_view bufferView = getBufferView(viewIndex);
+
+			AccessorView view{};
+			size_t offset = accessor.value("byteOffset", size_t(0));
+			view.stride = gltf.at("bufferViews").at(viewIndex).value("byteStride", elementSize);
+			view.count = accessor.at("count").get<size_t>();
+			view.componentType = accessor.at("componentType").get<uint32_t>();
+			if (view.count > 0 && offset + view.stride * (view.count - 1) + elementSize > bufferView.size()) {
+				std::cerr << "glTF accessor out of range in " << filename << "\n";
+				std::abort();
+			}
+			view.data = bufferView.data() + offset;
+			return view;
+		};
+
+		constexpr uint32_t componentUnsignedByte = 5121;
+		constexpr uint32_t componentUnsignedShort = 5123;
+		constexpr uint32_t componentUnsignedInt = 5125;
+		constexpr uint32_t componentFloat = 5126;
+		constexpr uint32_t modeTriangles = 4;
+
+		Scene scene;
+
+		// Images are decoded in parallel; textures refer to them by source
+		const nlohmann::json& images = gltf.value("images", nlohmann::json::array());
+		scene.textures.resize(images.size());
+		jobs.parallelFor(images.size(), [&](size_t i) {
+			const nlohmann::json& image = images[i];
+			std::string name = image.value("name", "image " + std::to_string(i));
+			if (image.contains("bufferView")) {
+				std::string_view bytes = getBufferView(image["bufferView"].get<size_t>());
+				scene.textures[i] = decodeImage(
+					reinterpret_cast<const stbi_uc*>(bytes.data()), bytes.size(), name);
+			}
+			else if (image.contains("uri") && !image["uri"].get<std::string>().starts_with("data:")) {
+				// External file next to the GLB
+				std::string uri = image["uri"].get<std::string>();
+				size_t slash = filename.find_last_of("/\\");
+				std::string path = slash == std::string::npos ? uri : filename.substr(0, slash + 1) + uri;
+				std::vector<char> bytes = readFile(path);
+				scene.textures[i] = decodeImage(
+					reinterpret_cast<const stbi_uc*>(bytes.data()), bytes.size(), name);
+			}
+			else {
+				std::cerr << "Unsupported image source for " << name << " in " << filename << "\n";
+			}
+		});
+
+		const nlohmann::json& textures = gltf.value("textures", nlohmann::json::array());
+		for (const auto& material : gltf.value("materials", nlohmann::json::array())) {
+			Material m{};
+			const nlohmann::json& pbr = material.value("pbrMetallicRoughness", nlohmann::json::object());
+			auto baseColor = pbr.value("baseColorFactor", std::array<float, 4>{ 1.0f, 1.0f, 1.0f, 1.0f });
+			auto emissive = material.value("emissiveFactor", std::array<float, 3>{ 0.0f, 0.0f, 0.0f });
+			std::copy(baseColor.begin(), baseColor.end(), m.baseColor);
+			std::copy(emissive.begin(), emissive.end(), m.emissive);
+			m.roughness = pbr.value("roughnessFactor", 1.0f);
+			m.metallic = pbr.value("metallicFactor", 1.0f);
+			if (pbr.contains("baseColorTexture")) {
+				size_t texture = pbr["baseColorTexture"].at("index").get<size_t>();
+				if (texture < textures.size() && textures[texture].contains("source")) {
+					m.baseColorTexture = textures[texture]["source"].get<int32_t>();
+				}
+			}
+			scene.materials.push_back(m);
+		}
+
+		// Every triangle primitive becomes a Mesh so it keeps its own material
+		const nlohmann::json& meshes = gltf.value("meshes", nlohmann::json::array());
+		std::vector<std::vector<Mesh>> primitiveMeshes(meshes.size());
+		jobs.parallelFor(meshes.size(), [&](size_t m) {
+			std::string name = meshes[m].value("name", std::string{});
+
+			for (const auto& primitive : meshes[m].at("primitives")) {
+				if (primitive.value("mode", modeTriangles) != modeTriangles) {
+					continue;
+				}
+
+				const nlohmann::json& attributes = primitive.at("attributes");
+				if (!attributes.contains("POSITION")) {
+					continue;
+				}
+				AccessorView positions = getAccessor(attributes["POSITION"].get<size_t>(), sizeof(float) * 3);
+				if (positions.componentType != componentFloat) {
+					std::cerr << "Only float positions are supported: " << filename << "\n";
+					std::abort();
+				}
+
+				Mesh& mesh = primitiveMeshes[m].emplace_back();
+				mesh.name = name;
+				mesh.material = primitive.value("material", -1) + 1;
+				mesh.vertices.resize(positions.count);
+				for (size_t i = 0; i < positions.count; i++) {
+					std::memcpy(mesh.vertices[i].pose, positions.data + positions.stride * i, sizeof(float) * 3);
+				}
+
+				if (attributes.contains("NORMAL")) {
+					AccessorView normals = getAccessor(attributes["NORMAL"].get<size_t>(), sizeof(float) * 3);
+					for (size_t i = 0; i < std::min(normals.count, positions.count); i++) {
+						std::memcpy(mesh.vertices[i].normal, normals.data + normals.stride * i, sizeof(float) * 3);
+					}
+				}
+
+				if (attributes.contains("TEXCOORD_0")) {
+					AccessorView uvs = getAccessor(attributes["TEXCOORD_0"].get<size_t>(), sizeof(float) * 2);
+					if (uvs.componentType == componentFloat) {
+						for (size_t i = 0; i < std::min(uvs.count, positions.count); i++) {
+							std::memcpy(mesh.vertices[i].uv, uvs.data + uvs.stride * i, sizeof(float) * 2);
+						}
+					}
+				}
+
+				if (!primitive.contains("indices")) {
+					for (size_t i = 0; i < positions.count; i++) {
+						mesh.indices.push_back(static_cast<uint32_t>(i));
+					}
+				}
+				else {
+					size_t indexAccessor = primitive["indices"].get<size_t>();
+					uint32_t componentType = gltf.at("accessors").at(indexAccessor).at("componentType").get<uint32_t>();
+					size_t indexSize =
+						componentType == componentUnsignedByte ? 1 :
+						componentType == componentUnsignedShort ? 2 : 4;
+					AccessorView indices = getAccessor(indexAccessor, indexSize);
+					for (size_t i = 0; i < indices.count; i++) {
+						const char* src = indices.data + indices.stride * i;
+						uint32_t index = 0;
+						if (componentType == componentUnsignedByte) {
+							index = static_cast<uint8_t>(*src);
+						}
+						else if (componentType == componentUnsignedShort) {
+							uint16_t value;
+							std::memcpy(&value, src, 2);
+							index = value;
+						}
+						else if (componentType == componentUnsignedInt) {
+							std::memcpy(&index, src, 4);
+						}
+						if (index >= mesh.vertices.size()) {
+							std::cerr << "Invalid vertex index " << index << " in " << filename << "\n";
+							std::abort();
+						}
+						mesh.indices.push_back(index);
+					}
+				}
+				fillMissingNormals(mesh);
+			}
+		});
+
+		// glTF mesh index -> first Mesh and number of primitives
+		std::vector<std::pair<uint32_t, uint32_t>> meshRanges;
+		for (auto& primitives : primitiveMeshes) {
+			meshRanges.emplace_back(static_cast<uint32_t>(scene.meshes.size()),
+				static_cast<uint32_t>(primitives.size()));
+			for (auto& mesh : primitives) {
+				scene.meshes.push_back(std::move(mesh));
+			}
+		}
+
+		// Flatten the node hierarchy into world space placements. glTF nodes
+		// form strict trees, so a node reached twice means a cycle or a shared
+		// child; either would recurse without bound or blow up the scene.
+		const nlohmann::json& nodes = gltf.value("nodes", nlohmann::json::array());
+		std::vector<bool> visited(nodes.size(), false);
+		std::function<void(size_t, const Matrix4&)> visit = [&](size_t index, const Matrix4& parent) {
+			const nlohmann::json& node = nodes.at(index);
+			if (visited[index]) {
+				std::cerr << "glTF node " << index << " is reached more than once in " << filename << "\n";
+				std::abort();
+			}
+			visited[index] = true;
+			Matrix4 world = multiply(parent, nodeMatrix(node));
+			if (node.contains("mesh")) {
+				size_t meshIndex = node["mesh"].get<size_t>();
+				if (meshIndex < meshRanges.size()) {
+					auto [first, count] = meshRanges[meshIndex];
+					for (uint32_t i = 0; i < count; i++) {
+						scene.nodes.push_back({ first + i, toTransform(world) });
+					}
+				}
+			}
+			for (const auto& child : node.value("children", nlohmann::json::array())) {
+				visit(child.get<size_t>(), world);
+			}
+		};
+
+		std::vector<size_t> roots;
+		if (gltf.contains("scenes")) {
+			size_t sceneIndex = gltf.value("scene", size_t(0));
+			for (const auto& node : gltf.at("scenes").at(sceneIndex).value("nodes", nlohmann::json::array())) {
+				roots.push_back(node.get<size_t>());
+			}
+		}
+		else {
+			std::vector<bool> isChild(nodes.size(), false);
+			for (const auto& node : nodes) {
+				for (const auto& child : node.value("children", nlohmann::json::array())) {
+					isChild.at(child.get<size_t>()) = true;
+				}
+			}
+			for (size_t i = 0; i < nodes.size(); i++) {
+				if (!isChild[i]) {
+					roots.push_back(i);
+				}
+			}
+		}
+		for (size_t root : roots) {
+			visit(root, identityMatrix);
+		}
+
+		// Meshes without triangles cannot become BLASes
+		std::erase_if(scene.nodes, [&](const SceneNode& node) {
+			return scene.meshes[node.mesh].indices.empty();
+		});
+		return scene;
+	}
+
+	// Picks the parser from the file extension (.obj or .glb)
+	inline Scene loadScene(const std::string& filename, JobSystem& jobs) {
+		std::cout << "Load scene: " << filename << std::endl;
+
+		auto endsWith = [&](std::string_view suffix) {
+			if (filename.size() < suffix.size()) {
+				return false;
+			}
+			return std::equal(suffix.rbegin(), suffix.rend(), filename.rbegin(),
+				[](char a, char b) { return a == std::tolower(static_cast<unsigned char>(b)); });
+		};
+
+		Scene scene;
+		if (endsWith(".obj")) {
+			scene = loadObj(filename, jobs);
+		}
+		else if (endsWith(".glb")) {
+			scene = loadGlb(filename, jobs);
+		}
+		else {
+			std::cerr << "Unsupported scene format: " << filename << "\n";
+			std::abort();
+		}
+
+		size_t triangleCount = 0;
+		for (const auto& mesh : scene.meshes) {
+			triangleCount += mesh.indices.size() / 3;
+		}
+		std::cout << "Loaded " << scene.meshes.size() << " meshes, "
+			<< scene.nodes.size() << " nodes, " << triangleCount << " triangles, "
+			<< scene.materials.size() << " materials, " << scene.textures.size() << " textures\n";
+		return scene;
+	}
+
+	// Scene used when no file is given
+	inline Scene makeTriangleScene() {
+		Mesh triangle{};
+		triangle.name = "triangle";
+		triangle.vertices = {
+			{{1.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f}},
+			{{-1.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}},
+			{{0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.5f, 1.0f}},
+		};
+		triangle.indices = { 0, 1, 2 };
+
+		Scene scene;
+		scene.meshes.push_back(std::move(triangle));
+		scene.nodes.push_back({ 0, identityTransform });
+		return scene;
+	}
+}  // namespace meshloader
@@ -0,0 +1,237 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+#include "vkutils.hpp"
+
+// Rolling statistics of one named scope, in milliseconds
+struct ScopeStats {
+	std::string name;
+	std::deque<double> history;
+	uint64_t sampleCount = 0;
+	double last = 0.0;
+	double min = 0.0;
+	double avg = 0.0;
+	double p99 = 0.0;
+};
+
+// GPU timestamps around named scopes. Each slot (one per frame in flight,
+// plus a few for one-time submissions) owns its own range of queries and is
+// read back only after its fence has signaled, so collecting never stalls.
+// Scopes may be recorded from several threads into different command buffers
+// of the same frame, and slots may be collected from scheduler callbacks.
+class GpuProfiler {
+public:
+	void init(vk::PhysicalDevice physicalDevice, vk::Device device,
+		uint32_t queueFamilyIndex, uint32_t frameCount,
+		uint32_t maxScopes = 32, size_t historySize = 256) {
+		std::cout << "Create GPU profiler\n";
+
+		uint32_t validBits =
+			physicalDevice.getQueueFamilyProperties()[queueFamilyIndex].timestampValidBits;
+		if (validBits == 0) {
+			std::cout << "Queue has no timestamp support, profiling disabled\n";
+			return;
+		}
+
+		this->device = device;
+		this->maxScopes = maxScopes;
+		this->historySize = historySize;
+		timestampPeriod = physicalDevice.getProperties().limits.timestampPeriod;
+		timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+		this->frameCount = frameCount;
+		slots.resize(frameCount + immediateSlotCount);
+
+		vk::QueryPoolCreateInfo createInfo{};
+		createInfo.setQueryType(vk::QueryType::eTimestamp);
+		createInfo.setQueryCount(static_cast<uint32_t>(slots.size()) * maxScopes * 2);
+		queryPool = device.createQueryPoolUnique(createInfo);
+	}
+
+	// Slots for one-time submissions. Submissions that can be in flight at
+	// the same time need different slots, since beginFrame() resets one.
+	static constexpr uint32_t immediateSlotCount = 2;
+	uint32_t getImmediateSlot(uint32_t index = 0) const { return frameCount + index; }
+
+	// Starts recording into a slot. Results of its previous use are collected
+	// first, so call this only after the slot's fence has been waited on.
+	void beginFrame(vk::CommandBuffer commandBuffer, uint32_t slot) {
+		if (!queryPool) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		collectSlot(slot);
+		commandBuffer.resetQueryPool(*queryPool, slot * maxScopes * 2, maxScopes * 2);
+		currentSlot = slot;
+	}
+
+	void beginScope(vk::CommandBuffer commandBuffer, const std::string& name) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<uint32_t>& open = openQueries[static_cast<VkCommandBuffer>(commandBuffer)];
+		if (!queryPool || slots[currentSlot].scopes.size() >= maxScopes) {
+			open.push_back(noQuery);
+			return;
+		}
+
+		Slot& slot = slots[currentSlot];
+		uint32_t query = (currentSlot * maxScopes + static_cast<uint32_t>(slot.scopes.size())) * 2;
+		slot.scopes.push_back(getScopeIndex(name));
+		commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *queryPool, query);
+		open.push_back(query);
+	}
+
+	// Ends the innermost scope begun in the same command buffer
+	void endScope(vk::CommandBuffer commandBuffer) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = openQueries.find(static_cast<VkCommandBuffer>(commandBuffer));
+		uint32_t query = it->second.back();
+		it->second.pop_back();
+		if (it->second.empty()) {
+			openQueries.erase(it);
+		}
+		if (query != noQuery) {
+			commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *queryPool, query + 1);
+		}
+	}
+
+	// Reads the finished timestamps of a slot into the statistics
+	void collect(uint32_t slot) {
+		std::lock_guard<std::mutex> lock(mutex);
+		collectSlot(slot);
+	}
+
+	// Collects every slot, call once the device is idle
+	void collectAll() {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (uint32_t slot = 0; slot < slots.size(); slot++) {
+			collectSlot(slot);
+		}
+	}
+
+	// A copy, since other threads may add samples meanwhile
+	std::vector<ScopeStats> getStats() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+	// Summary for regression tracking; .json files get JSON, anything else CSV
+	void writeLog(const std::string& filename) const {
+		std::ofstream file(filename);
+		if (!file.is_open()) {
+			std::cerr << "Failed to write profile log: " << filename << "\n";
+			return;
+		}
+
+		std::vector<ScopeStats> snapshot = getStats();
+		bool json = filename.size() >= 5 && filename.substr(filename.size() - 5) == ".json";
+		if (json) {
+			// The library escapes scope names
+			nlohmann::json scopes = nlohmann::json::array();
+			for (const ScopeStats& s : snapshot) {
+				scopes.push_back({
+					{ "name", s.name },
+					{ "samples", s.sampleCount },
+					{ "min_ms", s.min },
+					{ "avg_ms", s.avg },
+					{ "p99_ms", s.p99 },
+				});
+			}
+			file << nlohmann::json{ { "scopes", scopes } }.dump(2) << "\n";
+		}
+		else {
+			file << "scope,samples,min_ms,avg_ms,p99_ms\n";
+			for (const ScopeStats& s : snapshot) {
+				file << escapeCsv(s.name) << "," << s.sampleCount << ","
+					<< s.min << "," << s.avg << "," << s.p99 << "\n";
+			}
+		}
+		std::cout << "Write profile log: " << filename << "\n";
+	}
+
+private:
+	struct Slot {
+		std::vector<uint32_t> scopes;
+	};
+
+	static constexpr uint32_t noQuery = UINT32_MAX;
+
+	// Quotes fields containing separators, quotes or line breaks (RFC 4180)
+	static std::string escapeCsv(const std::string& field) {
+		if (field.find_first_of(",\"\r\n") == std::string::npos) {
+			return field;
+		}
+		std::string quoted = "\"";
+		for (char c : field) {
+			if (c == '"') {
+				quoted += '"';
+			}
+			quoted += c;
+		}
+		return quoted + "\"";
+	}
+
+	// collect() with the mutex held
+	void collectSlot(uint32_t slot) {
+		if (!queryPool || slots[slot].scopes.empty()) {
+			return;
+		}
+
+		std::vector<uint32_t>& scopes = slots[slot].scopes;
+		uint32_t queryCount = static_cast<uint32_t>(scopes.size()) * 2;
+		auto timestamps = device.getQueryPoolResults<uint64_t>(
+			*queryPool, slot * maxScopes * 2, queryCount,
+			queryCount * sizeof(uint64_t), sizeof(uint64_t),
+			vk::QueryResultFlagBits::e64);
+		if (timestamps.result == vk::Result::eSuccess) {
+			for (size_t i = 0; i < scopes.size(); i++) {
+				uint64_t ticks = (timestamps.value[i * 2 + 1] - timestamps.value[i * 2]) & timestampMask;
+				addSample(stats[scopes[i]], ticks * timestampPeriod * 1e-6);
+			}
+		}
+		scopes.clear();
+	}
+
+	uint32_t getScopeIndex(const std::string& name) {
+		for (uint32_t i = 0; i < stats.size(); i++) {
+			if (stats[i].name == name) {
+				return i;
+			}
+		}
+		stats.push_back({ name });
+		return static_cast<uint32_t>(stats.size()) - 1;
+	}
+
+	void addSample(ScopeStats& s, double ms) {
+		s.history.push_back(ms);
+		if (s.history.size() > historySize) {
+			s.history.pop_front();
+		}
+		s.sampleCount++;
+		s.last = ms;
+
+		std::vector<double> sorted(s.history.begin(), s.history.end());
+		std::sort(sorted.begin(), sorted.end());
+		double sum = 0.0;
+		for (double value : sorted) {
+			sum += value;
+		}
+		s.min = sorted.front();
+		s.avg = sum / sorted.size();
+		s.p99 = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+	}
+
+	vk::Device device;
+	vk::UniqueQueryPool queryPool;
+	uint32_t frameCount = 0;
+	uint32_t maxScopes = 0;
+	size_t historySize = 0;
+	float timestampPeriod = 1.0f;
+	uint64_t timestampMask = ~0ull;
+
+	std::vector<Slot> slots;
+	uint32_t currentSlot = 0;
+	std::unordered_map<VkCommandBuffer, std::vector<uint32_t>> openQueries;  // per recording command buffer
+	std::vector<ScopeStats> stats;
+	mutable std::mutex mutex;  // guards slots, stats and scope recording
+};
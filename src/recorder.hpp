@@ -0,0 +1,119 @@
+#pragma once
+#include <functional>
+#include <optional>
+#include "jobs.hpp"
+#include "vkutils.hpp"
+
+// Records independent passes of a frame into secondary command buffers on
+// the job system's threads; the primary buffer then executes them in the
+// order they were added. A command pool may only be used by one thread at a
+// time, so every frame in flight has a pool per thread, reset as a whole
+// once the frame's fence has signaled.
+class ParallelRecorder {
+public:
+	using RecordFunction = std::function<void(vk::CommandBuffer)>;
+
+	void init(vk::Device device, uint32_t queueFamilyIndex, uint32_t frameCount, JobSystem& jobs) {
+		std::cout << "Create parallel recorder\n";
+
+		this->device = device;
+		this->jobs = &jobs;
+		frames.resize(frameCount);
+		for (auto& frame : frames) {
+			frame.pools.resize(jobs.getThreadCount());
+			for (auto& pool : frame.pools) {
+				vk::CommandPoolCreateInfo createInfo{};
+				createInfo.setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+				createInfo.setQueueFamilyIndex(queueFamilyIndex);
+				pool.pool = device.createCommandPoolUnique(createInfo);
+			}
+		}
+	}
+
+	// Recycles the frame's secondary buffers, call after its fence was waited on
+	void beginFrame(uint32_t frame) {
+		currentFrame = frame;
+		for (auto& pool : frames[frame].pools) {
+			device.resetCommandPool(*pool.pool);
+			pool.used = 0;
+		}
+		passes.clear();
+	}
+
+	// Adds a pass recorded outside of any render pass. Returns its index
+	// into the buffers returned by record().
+	uint32_t addPass(RecordFunction function) {
+		passes.push_back({ std::move(function), std::nullopt });
+		return static_cast<uint32_t>(passes.size()) - 1;
+	}
+
+	// Adds a pass that continues `subpass` of a render pass begun with
+	// vk::SubpassContents::eSecondaryCommandBuffers
+	uint32_t addPass(RecordFunction function, vk::RenderPass renderPass, uint32_t subpass,
+		vk::Framebuffer framebuffer) {
+		passes.push_back({ std::move(function), vk::CommandBufferInheritanceInfo{ renderPass, subpass, framebuffer } });
+		return static_cast<uint32_t>(passes.size()) - 1;
+	}
+
+	// Records every pass added since beginFrame() in parallel and waits
+	std::vector<vk::CommandBuffer> record() {
+		std::vector<vk::CommandBuffer> buffers(passes.size());
+		JobSystem::Group group;
+		for (size_t i = 0; i < passes.size(); i++) {
+			jobs->run(group, [this, &buffers, i]() {
+				const Pass& pass = passes[i];
+				vk::CommandBuffer commandBuffer = acquire(JobSystem::getThreadIndex());
+
+				vk::CommandBufferInheritanceInfo inheritance = pass.renderPass.value_or(vk::CommandBufferInheritanceInfo{});
+				vk::CommandBufferBeginInfo beginInfo{};
+				beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+				if (pass.renderPass) {
+					beginInfo.flags |= vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+				}
+				beginInfo.setPInheritanceInfo(&inheritance);
+
+				commandBuffer.begin(beginInfo);
+				pass.function(commandBuffer);
+				commandBuffer.end();
+				buffers[i] = commandBuffer;
+			});
+		}
+		jobs->wait(group);
+		return buffers;
+	}
+
+private:
+	struct Pass {
+		RecordFunction function;
+		std::optional<vk::CommandBufferInheritanceInfo> renderPass;
+	};
+
+	struct ThreadPool {
+		vk::UniqueCommandPool pool;
+		std::vector<vk::CommandBuffer> buffers;  // freed with the pool
+		size_t used = 0;
+	};
+
+	struct FramePools {
+		std::vector<ThreadPool> pools;  // indexed by JobSystem::getThreadIndex()
+	};
+
+	// Only the calling thread touches its pool, so no lock is needed
+	vk::CommandBuffer acquire(uint32_t threadIndex) {
+		ThreadPool& pool = frames[currentFrame].pools[threadIndex];
+		if (pool.used == pool.buffers.size()) {
+			vk::CommandBufferAllocateInfo allocateInfo{};
+			allocateInfo.setCommandPool(*pool.pool);
+			allocateInfo.setLevel(vk::CommandBufferLevel::eSecondary);
+			allocateInfo.setCommandBufferCount(1);
+			pool.buffers.push_back(device.allocateCommandBuffers(allocateInfo).front());
+		}
+		return pool.buffers[pool.used++];
+	}
+
+	vk::Device device;
+	JobSystem* jobs = nullptr;
+	std::vector<FramePools> frames;
+	uint32_t currentFrame = 0;
+	std::vector<Pass> passes;
+};
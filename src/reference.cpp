@@ -0,0 +1,105 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "cameraview.hpp"
+#include "reference.hpp"
+
+// Renders the normal view on the CPU and optionally compares it with an
+// image written by `--headless --normals`. Exits with 1 when they differ.
+struct ReferenceOptions {
+	std::string scenePath;  // a single triangle when empty
+	std::string outputPath = "reference.ppm";
+	uint32_t width = 800;
+	uint32_t height = 600;
+
+	// GPU image to compare against, none when empty
+	std::string comparePath;
+	std::string diffPath;         // per pixel difference image, none when empty
+	uint32_t tolerance = 2;       // allowed channel difference (rounding)
+	double maxDifferent = 0.005;  // fraction of pixels allowed to differ (edges)
+};
+
+ReferenceOptions parseOptions(int argc, char** argv) {
+	ReferenceOptions options{};
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--scene" && i + 1 < argc) {
+			options.scenePath = argv[++i];
+		}
+		else if (arg == "--output" && i + 1 < argc) {
+			options.outputPath = argv[++i];
+		}
+		else if (arg == "--width" && i + 1 < argc) {
+			options.width = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		}
+		else if (arg == "--height" && i + 1 < argc) {
+			options.height = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		}
+		else if (arg == "--compare" && i + 1 < argc) {
+			options.comparePath = argv[++i];
+		}
+		else if (arg == "--diff" && i + 1 < argc) {
+			options.diffPath = argv[++i];
+		}
+		else if (arg == "--tolerance" && i + 1 < argc) {
+			options.tolerance = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--max-different" && i + 1 < argc) {
+			options.maxDifferent = std::stod(argv[++i]);
+		}
+		else {
+			std::cerr << "Unknown argument: " << arg << "\n";
+			std::abort();
+		}
+	}
+	return options;
+}
+
+int main(int argc, char** argv) {
+	ReferenceOptions options = parseOptions(argc, argv);
+
+	JobSystem jobs;
+	jobs.init();
+
+	Scene scene = options.scenePath.empty()
+		? meshloader::makeTriangleScene()
+		: meshloader::loadScene(options.scenePath, jobs);
+
+	reference::Renderer renderer;
+	renderer.build(scene, jobs);
+
+	// Same values the application pushes for its initial view
+	CameraView camera;
+	auto toVec3 = [](const glm::vec3& v) { return reference::Vec3{ v.x, v.y, v.z }; };
+	reference::ReferenceCamera view;
+	view.origin = toVec3(camera.position);
+	view.forward = toVec3(camera.getForward());
+	view.right = toVec3(camera.getRight());
+	view.up = toVec3(camera.getUp());
+	view.tanHalfFovY = std::tan(0.5f * glm::radians(camera.fovY));
+	view.aspect = static_cast<float>(options.width) / static_cast<float>(options.height);
+
+	std::vector<uint8_t> pixels = renderer.renderNormals(view, options.width, options.height, jobs);
+	std::cout << "Save image: " << options.outputPath << std::endl;
+	reference::writePpm(options.outputPath, options.width, options.height, pixels);
+
+	if (options.comparePath.empty()) {
+		return 0;
+	}
+
+	uint32_t gpuWidth = 0;
+	uint32_t gpuHeight = 0;
+	std::vector<uint8_t> gpuPixels = reference::readPpm(options.comparePath, gpuWidth, gpuHeight);
+	if (gpuWidth != options.width || gpuHeight != options.height) {
+		std::cerr << "Image size mismatch: " << gpuWidth << "x" << gpuHeight << " vs "
+			<< options.width << "x" << options.height << "\n";
+		return 1;
+	}
+
+	reference::ImageDiff diff = reference::diffImages(pixels, gpuPixels, options.tolerance);
+	if (!options.diffPath.empty()) {
+		reference::writePpm(options.diffPath, options.width, options.height, diff.image);
+	}
+	double different = static_cast<double>(diff.differentPixels) / (static_cast<double>(options.width) * options.height);
+	std::cout << "Different pixels: " << diff.differentPixels << " (" << different * 100.0 << "%), "
+		<< "max difference: " << diff.maxDifference << ", mean difference: " << diff.meanDifference << "\n";
+	return different > options.maxDifferent ? 1 : 0;
+}
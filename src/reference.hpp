@@ -0,0 +1,764 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "mesh.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REFERENCE_SSE2
+#endif
+
+// CPU reference renderer. Builds a two level BVH over the same vertex and
+// index data and node transforms that go into the BLASes and the TLAS, and
+// traces packets of primary rays with SSE or AVX2. It renders the normal
+// view of raygen.rgen (RenderView), so its image can be diffed against the
+// GPU's, and it needs no GPU at all.
+namespace reference {
+	struct Vec3 {
+		float x = 0.0f;
+		float y = 0.0f;
+		float z = 0.0f;
+
+		float operator[](int axis) const { return axis == 0 ? x : axis == 1 ? y : z; }
+	};
+
+	inline Vec3 operator+(Vec3 a, Vec3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	inline Vec3 operator-(Vec3 a, Vec3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	inline Vec3 operator*(Vec3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+	inline Vec3 min(Vec3 a, Vec3 b) { return { std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) }; }
+	inline Vec3 max(Vec3 a, Vec3 b) { return { std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) }; }
+	inline float dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline Vec3 cross(Vec3 a, Vec3 b) {
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+	inline Vec3 normalize(Vec3 v) { return v * (1.0f / std::sqrt(dot(v, v))); }
+
+	struct Aabb {
+		Vec3 min{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+		Vec3 max{ -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+
+		void grow(Vec3 p) {
+			min = reference::min(min, p);
+			max = reference::max(max, p);
+		}
+		void grow(const Aabb& box) {
+			min = reference::min(min, box.min);
+			max = reference::max(max, box.max);
+		}
+		Vec3 center() const { return (min + max) * 0.5f; }
+		float area() const {
+			Vec3 e = max - min;
+			return e.x < 0.0f ? 0.0f : 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+		}
+	};
+
+	// Ray packet lanes. Each backend provides the same operators, the
+	// traversal below is written once against them.
+#if defined(__AVX2__)
+	struct Floats {
+		static constexpr int width = 8;
+		__m256 v;
+		Floats() = default;
+		Floats(__m256 v) : v(v) {}
+		Floats(float s) : v(_mm256_set1_ps(s)) {}
+		static Floats load(const float* p) { return _mm256_loadu_ps(p); }
+		void store(float* p) const { _mm256_storeu_ps(p, v); }
+	};
+	struct Mask {
+		__m256 v;
+		Mask() = default;
+		Mask(__m256 v) : v(v) {}
+		static Mask load(const bool* p) {
+			alignas(32) int32_t bits[8];
+			for (int i = 0; i < 8; i++) {
+				bits[i] = p[i] ? -1 : 0;
+			}
+			return _mm256_castsi256_ps(_mm256_load_si256(reinterpret_cast<const __m256i*>(bits)));
+		}
+		bool any() const { return _mm256_movemask_ps(v) != 0; }
+		uint32_t bits() const { return static_cast<uint32_t>(_mm256_movemask_ps(v)); }
+	};
+	inline Floats operator+(Floats a, Floats b) { return _mm256_add_ps(a.v, b.v); }
+	inline Floats operator-(Floats a, Floats b) { return _mm256_sub_ps(a.v, b.v); }
+	inline Floats operator*(Floats a, Floats b) { return _mm256_mul_ps(a.v, b.v); }
+	inline Floats operator/(Floats a, Floats b) { return _mm256_div_ps(a.v, b.v); }
+	inline Floats min(Floats a, Floats b) { return _mm256_min_ps(a.v, b.v); }
+	inline Floats max(Floats a, Floats b) { return _mm256_max_ps(a.v, b.v); }
+	inline Floats abs(Floats a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+	inline Mask operator<(Floats a, Floats b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+	inline Mask operator<=(Floats a, Floats b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+	inline Mask operator>(Floats a, Floats b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+	inline Mask operator>=(Floats a, Floats b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+	inline Mask operator&(Mask a, Mask b) { return _mm256_and_ps(a.v, b.v); }
+	inline Floats select(Mask m, Floats a, Floats b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+#elif defined(REFERENCE_SSE2)
+	struct Floats {
+		static constexpr int width = 4;
+		__m128 v;
+		Floats() = default;
+		Floats(__m128 v) : v(v) {}
+		Floats(float s) : v(_mm_set1_ps(s)) {}
+		static Floats load(const float* p) { return _mm_loadu_ps(p); }
+		void store(float* p) const { _mm_storeu_ps(p, v); }
+	};
+	struct Mask {
+		__m128 v;
+		Mask() = default;
+		Mask(__m128 v) : v(v) {}
+		static Mask load(const bool* p) {
+			return _mm_castsi128_ps(_mm_set_epi32(p[3] ? -1 : 0, p[2] ? -1 : 0, p[1] ? -1 : 0, p[0] ? -1 : 0));
+		}
+		bool any() const { return _mm_movemask_ps(v) != 0; }
+		uint32_t bits() const { return static_cast<uint32_t>(_mm_movemask_ps(v)); }
+	};
+	inline Floats operator+(Floats a, Floats b) { return _mm_add_ps(a.v, b.v); }
+	inline Floats operator-(Floats a, Floats b) { return _mm_sub_ps(a.v, b.v); }
+	inline Floats operator*(Floats a, Floats b) { return _mm_mul_ps(a.v, b.v); }
+	inline Floats operator/(Floats a, Floats b) { return _mm_div_ps(a.v, b.v); }
+	inline Floats min(Floats a, Floats b) { return _mm_min_ps(a.v, b.v); }
+	inline Floats max(Floats a, Floats b) { return _mm_max_ps(a.v, b.v); }
+	inline Floats abs(Floats a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+	inline Mask operator<(Floats a, Floats b) { return _mm_cmplt_ps(a.v, b.v); }
+	inline Mask operator<=(Floats a, Floats b) { return _mm_cmple_ps(a.v, b.v); }
+	inline Mask operator>(Floats a, Floats b) { return _mm_cmpgt_ps(a.v, b.v); }
+	inline Mask operator>=(Floats a, Floats b) { return _mm_cmpge_ps(a.v, b.v); }
+	inline Mask operator&(Mask a, Mask b) { return _mm_and_ps(a.v, b.v); }
+	// SSE2 has no blendv
+	inline Floats select(Mask m, Floats a, Floats b) {
+		return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v));
+	}
+#else
+	// Portable fallback, left to the compiler's auto-vectorizer
+	struct Floats {
+		static constexpr int width = 4;
+		std::array<float, 4> v;
+		Floats() = default;
+		Floats(float s) { v.fill(s); }
+		static Floats load(const float* p) {
+			Floats f;
+			std::copy(p, p + width, f.v.begin());
+			return f;
+		}
+		void store(float* p) const { std::copy(v.begin(), v.end(), p); }
+	};
+	struct Mask {
+		std::array<bool, 4> v;
+		static Mask load(const bool* p) {
+			Mask m;
+			std::copy(p, p + Floats::width, m.v.begin());
+			return m;
+		}
+		bool any() const { return v[0] || v[1] || v[2] || v[3]; }
+		uint32_t bits() const {
+			return (v[0] ? 1u : 0u) | (v[1] ? 2u : 0u) | (v[2] ? 4u : 0u) | (v[3] ? 8u : 0u);
+		}
+	};
+	template <typename Op>
+	inline Floats lanewise(Floats a, Floats b, Op op) {
+		Floats r;
+		for (int i = 0; i < Floats::width; i++) {
+			r.v[i] = op(a.v[i], b.v[i]);
+		}
+		return r;
+	}
+	template <typename Op>
+	inline Mask compare(Floats a, Floats b, Op op) {
+		Mask r;
+		for (int i = 0; i < Floats::width; i++) {
+			r.v[i] = op(a.v[i], b.v[i]);
+		}
+		return r;
+	}
+	inline Floats operator+(Floats a, Floats b) { return lanewise(a, b, [](float x, float y) { return x + y; }); }
+	inline Floats operator-(Floats a, Floats b) { return lanewise(a, b, [](float x, float y) { return x - y; }); }
+	inline Floats operator*(Floats a, Floats b) { return lanewise(a, b, [](float x, float y) { return x * y; }); }
+	inline Floats operator/(Floats a, Floats b) { return lanewise(a, b, [](float x, float y) { return x / y; }); }
+	inline Floats min(Floats a, Floats b) { return lanewise(a, b, [](float x, float y) { return y < x ? y : x; }); }
+	inline Floats max(Floats a, Floats b) { return lanewise(a, b, [](float x, float y) { return y > x ? y : x; }); }
+	inline Floats abs(Floats a) { return lanewise(a, a, [](float x, float) { return std::abs(x); }); }
+	inline Mask operator<(Floats a, Floats b) { return compare(a, b, [](float x, float y) { return x < y; }); }
+	inline Mask operator<=(Floats a, Floats b) { return compare(a, b, [](float x, float y) { return x <= y; }); }
+	inline Mask operator>(Floats a, Floats b) { return compare(a, b, [](float x, float y) { return x > y; }); }
+	inline Mask operator>=(Floats a, Floats b) { return compare(a, b, [](float x, float y) { return x >= y; }); }
+	inline Mask operator&(Mask a, Mask b) {
+		Mask r;
+		for (int i = 0; i < Floats::width; i++) {
+			r.v[i] = a.v[i] && b.v[i];
+		}
+		return r;
+	}
+	inline Floats select(Mask m, Floats a, Floats b) {
+		Floats r;
+		for (int i = 0; i < Floats::width; i++) {
+			r.v[i] = m.v[i] ? a.v[i] : b.v[i];
+		}
+		return r;
+	}
+#endif
+
+	// Lanes of a 3-vector
+	struct Vec3s {
+		Floats x, y, z;
+	};
+
+	inline Vec3s broadcast(Vec3 v) { return { Floats(v.x), Floats(v.y), Floats(v.z) }; }
+	inline Vec3s operator-(const Vec3s& a, const Vec3s& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	inline Floats dot(const Vec3s& a, const Vec3s& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline Vec3s cross(const Vec3s& a, const Vec3s& b) {
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	// Keeps 1 / d finite, so that the slab test never computes 0 * inf
+	inline Floats safeReciprocal(Floats d) {
+		const Floats epsilon = 1e-20f;
+		Floats magnitude = max(abs(d), epsilon);
+		return select(d < 0.0f, Floats(-1.0f), Floats(1.0f)) / magnitude;
+	}
+
+	struct RayPacket {
+		Vec3s origin;
+		Vec3s direction;
+		Vec3s inverseDirection;
+		Mask active;
+	};
+
+	// Closest hit per lane; normal is the world space geometric normal
+	struct HitPacket {
+		Floats t;
+		Vec3s normal;
+	};
+
+	// Near distance of raygen.rgen's traceRayEXT
+	inline constexpr float rayTMin = 0.001f;
+	inline constexpr float rayTMax = 10000.0f;
+
+	// Binary BVH built with binned SAH. Children of an inner node are stored
+	// next to each other; leaves reference a range of `indices`.
+	class Bvh {
+	public:
+		struct Node {
+			Aabb bounds;
+			uint32_t first = 0;  // left child, or first index of a leaf
+			uint16_t count = 0;  // primitives in a leaf, 0 for inner nodes
+			uint16_t axis = 0;   // split axis, orders the children
+		};
+
+		void build(const std::vector<Aabb>& primitiveBounds) {
+			nodes.clear();
+			indices.resize(primitiveBounds.size());
+			for (uint32_t i = 0; i < indices.size(); i++) {
+				indices[i] = i;
+			}
+			centers.resize(primitiveBounds.size());
+			for (size_t i = 0; i < primitiveBounds.size(); i++) {
+				centers[i] = primitiveBounds[i].center();
+			}
+
+			nodes.reserve(std::max<size_t>(2 * primitiveBounds.size(), 1));
+			nodes.push_back({});
+			subdivide(0, 0, static_cast<uint32_t>(indices.size()), 0, primitiveBounds);
+			centers.clear();
+			centers.shrink_to_fit();
+		}
+
+		std::vector<Node> nodes;
+		std::vector<uint32_t> indices;
+
+	private:
+		static constexpr uint32_t binCount = 16;
+		static constexpr uint32_t maxLeafSize = 4;
+		// Keeps the traversal stack bounded, makeLeaf() adds at most 16 levels
+		static constexpr uint32_t maxDepth = 40;
+
+		// Fills node `nodeIndex` with primitives [first, first + count)
+		void subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth,
+			const std::vector<Aabb>& primitiveBounds) {
+			Aabb bounds;
+			Aabb centerBounds;
+			for (uint32_t i = first; i < first + count; i++) {
+				bounds.grow(primitiveBounds[indices[i]]);
+				centerBounds.grow(centers[indices[i]]);
+			}
+			nodes[nodeIndex].bounds = bounds;
+
+			// Best split over all axes; the cost is relative to one intersection
+			float bestCost = std::numeric_limits<float>::max();
+			int bestAxis = -1;
+			uint32_t bestBin = 0;
+			for (int axis = 0; axis < 3; axis++) {
+				float lo = centerBounds.min[axis];
+				float extent = centerBounds.max[axis] - lo;
+				if (extent <= 0.0f) {
+					continue;
+				}
+				float scale = binCount / extent;
+
+				std::array<Aabb, binCount> bins;
+				std::array<uint32_t, binCount> binCounts{};
+				for (uint32_t i = first; i < first + count; i++) {
+					uint32_t bin = std::min(binCount - 1,
+						static_cast<uint32_t>((centers[indices[i]][axis] - lo) * scale));
+					bins[bin].grow(primitiveBounds[indices[i]]);
+					binCounts[bin]++;
+				}
+
+				// Sweep from the right, then evaluate every plane from the left
+				std::array<float, binCount> rightCosts{};
+				Aabb right;
+				uint32_t rightCount = 0;
+				for (uint32_t b = binCount - 1; b > 0; b--) {
+					right.grow(bins[b]);
+					rightCount += binCounts[b];
+					rightCosts[b] = rightCount > 0 ? right.area() * rightCount : 0.0f;
+				}
+				Aabb left;
+				uint32_t leftCount = 0;
+				for (uint32_t b = 0; b < binCount - 1; b++) {
+					left.grow(bins[b]);
+					leftCount += binCounts[b];
+					if (leftCount == 0 || leftCount == count) {
+						continue;
+					}
+					float cost = left.area() * leftCount + rightCosts[b + 1];
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestBin = b;
+					}
+				}
+			}
+
+			float leafCost = bounds.area() * count;
+			float splitCost = bounds.area() + bestCost;  // one box test + children
+			if (bestAxis < 0 || depth >= maxDepth || (count <= maxLeafSize && splitCost >= leafCost)) {
+				makeLeaf(nodeIndex, first, count);
+				return;
+			}
+
+			float lo = centerBounds.min[bestAxis];
+			float scale = binCount / (centerBounds.max[bestAxis] - lo);
+			auto middle = std::partition(indices.begin() + first, indices.begin() + first + count,
+				[&](uint32_t i) {
+					uint32_t bin = std::min(binCount - 1, static_cast<uint32_t>((centers[i][bestAxis] - lo) * scale));
+					return bin <= bestBin;
+				});
+			uint32_t leftCount = static_cast<uint32_t>(middle - (indices.begin() + first));
+
+			uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+			nodes.push_back({});
+			nodes.push_back({});
+			nodes[nodeIndex].first = leftIndex;
+			nodes[nodeIndex].count = 0;
+			nodes[nodeIndex].axis = static_cast<uint16_t>(bestAxis);
+			subdivide(leftIndex, first, leftCount, depth + 1, primitiveBounds);
+			subdivide(leftIndex + 1, first + leftCount, count - leftCount, depth + 1, primitiveBounds);
+		}
+
+		// Leaves hold at most 65535 primitives, larger groups of identical
+		// centers are split in the middle
+		void makeLeaf(uint32_t nodeIndex, uint32_t first, uint32_t count) {
+			if (count <= std::numeric_limits<uint16_t>::max()) {
+				nodes[nodeIndex].first = first;
+				nodes[nodeIndex].count = static_cast<uint16_t>(count);
+				return;
+			}
+			uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+			nodes.push_back({ nodes[nodeIndex].bounds });
+			nodes.push_back({ nodes[nodeIndex].bounds });
+			nodes[nodeIndex].first = leftIndex;
+			nodes[nodeIndex].count = 0;
+			makeLeaf(leftIndex, first, count / 2);
+			makeLeaf(leftIndex + 1, first + count / 2, count - count / 2);
+		}
+
+		std::vector<Vec3> centers;
+	};
+
+	// Returns which packet lanes enter the box before their current hit
+	inline Mask intersectBox(const RayPacket& ray, const Floats& tMax, const Aabb& box) {
+		Floats tx0 = (Floats(box.min.x) - ray.origin.x) * ray.inverseDirection.x;
+		Floats tx1 = (Floats(box.max.x) - ray.origin.x) * ray.inverseDirection.x;
+		Floats ty0 = (Floats(box.min.y) - ray.origin.y) * ray.inverseDirection.y;
+		Floats ty1 = (Floats(box.max.y) - ray.origin.y) * ray.inverseDirection.y;
+		Floats tz0 = (Floats(box.min.z) - ray.origin.z) * ray.inverseDirection.z;
+		Floats tz1 = (Floats(box.max.z) - ray.origin.z) * ray.inverseDirection.z;
+		Floats tEnter = max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), Floats(rayTMin)));
+		Floats tExit = min(min(max(tx0, tx1), max(ty0, ty1)), min(max(tz0, tz1), tMax));
+		return ray.active & (tEnter <= tExit);
+	}
+
+	// Camera of raygen.rgen, filled from the same values as PushConstants
+	struct ReferenceCamera {
+		Vec3 origin;
+		Vec3 forward;
+		Vec3 right;
+		Vec3 up;
+		float tanHalfFovY = 1.0f;
+		float aspect = 1.0f;
+	};
+
+	class Renderer {
+	public:
+		void build(const Scene& scene, JobSystem& jobs) {
+			std::cout << "Build reference BVH\n";
+			auto start = std::chrono::steady_clock::now();
+
+			// One BLAS per mesh, triangles stored as vertex + two edges
+			meshes.resize(scene.meshes.size());
+			jobs.parallelFor(scene.meshes.size(), [&](size_t m) {
+				const Mesh& mesh = scene.meshes[m];
+				MeshBvh& target = meshes[m];
+				size_t triangleCount = mesh.indices.size() / 3;
+				std::vector<Triangle> triangles(triangleCount);
+				std::vector<Aabb> bounds(triangleCount);
+				for (size_t i = 0; i < triangleCount; i++) {
+					Vec3 p[3];
+					for (int k = 0; k < 3; k++) {
+						const float* pose = mesh.vertices[mesh.indices[i * 3 + k]].pose;
+						p[k] = { pose[0], pose[1], pose[2] };
+						bounds[i].grow(p[k]);
+					}
+					triangles[i] = { p[0], p[1] - p[0], p[2] - p[0] };
+				}
+				target.bvh.build(bounds);
+
+				// Leaves then read triangles sequentially
+				target.triangles.resize(triangleCount);
+				for (size_t i = 0; i < triangleCount; i++) {
+					target.triangles[i] = triangles[target.bvh.indices[i]];
+				}
+			});
+
+			// TLAS over the world space bounds of every node
+			instances.clear();
+			std::vector<Aabb> instanceBounds;
+			for (const SceneNode& node : scene.nodes) {
+				if (meshes[node.mesh].triangles.empty()) {
+					continue;
+				}
+				Instance instance;
+				instance.mesh = node.mesh;
+				instance.worldToObject = invert(node.transform);
+				instances.push_back(instance);
+
+				const Aabb& local = meshes[node.mesh].bvh.nodes[0].bounds;
+				Aabb world;
+				for (int corner = 0; corner < 8; corner++) {
+					Vec3 p{ corner & 1 ? local.max.x : local.min.x,
+						corner & 2 ? local.max.y : local.min.y,
+						corner & 4 ? local.max.z : local.min.z };
+					world.grow(transformPoint(node.transform, p));
+				}
+				instanceBounds.push_back(world);
+			}
+			topLevel.build(instanceBounds);
+
+			// The TLAS leaves then read instances sequentially
+			std::vector<Instance> sorted(instances.size());
+			for (size_t i = 0; i < instances.size(); i++) {
+				sorted[i] = instances[topLevel.indices[i]];
+			}
+			instances = std::move(sorted);
+
+			auto end = std::chrono::steady_clock::now();
+			std::cout << "Reference BVH built in "
+				<< std::chrono::duration<double, std::milli>(end - start).count() << " ms ("
+				<< Floats::width << "-wide packets)\n";
+		}
+
+		// Renders the normal view of raygen.rgen into tightly packed RGB8
+		std::vector<uint8_t> renderNormals(const ReferenceCamera& camera, uint32_t width, uint32_t height,
+			JobSystem& jobs) const {
+			std::cout << "Render reference image\n";
+			auto start = std::chrono::steady_clock::now();
+
+			// Packets cover tiles of packetWidth x 2 pixels
+			constexpr uint32_t packetWidth = Floats::width / 2;
+			uint32_t packetsX = (width + packetWidth - 1) / packetWidth;
+			uint32_t packetsY = (height + 1) / 2;
+
+			std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+			jobs.parallelFor(packetsY, [&](size_t py) {
+				for (uint32_t px = 0; px < packetsX; px++) {
+					float dx[Floats::width], dy[Floats::width], dz[Floats::width];
+					bool inside[Floats::width];
+					for (int lane = 0; lane < Floats::width; lane++) {
+						uint32_t x = px * packetWidth + lane % packetWidth;
+						uint32_t y = static_cast<uint32_t>(py) * 2 + lane / packetWidth;
+						inside[lane] = x < width && y < height;
+
+						float ndcX = (static_cast<float>(x) + 0.5f) / static_cast<float>(width) * 2.0f - 1.0f;
+						float ndcY = (static_cast<float>(y) + 0.5f) / static_cast<float>(height) * 2.0f - 1.0f;
+						Vec3 d = normalize(camera.forward
+							+ camera.right * (ndcX * camera.tanHalfFovY * camera.aspect)
+							- camera.up * (ndcY * camera.tanHalfFovY));
+						dx[lane] = d.x;
+						dy[lane] = d.y;
+						dz[lane] = d.z;
+					}
+
+					RayPacket ray;
+					ray.origin = broadcast(camera.origin);
+					ray.direction = { Floats::load(dx), Floats::load(dy), Floats::load(dz) };
+					ray.inverseDirection = { safeReciprocal(ray.direction.x),
+						safeReciprocal(ray.direction.y), safeReciprocal(ray.direction.z) };
+					ray.active = Mask::load(inside);
+
+					HitPacket hit{ Floats(rayTMax), broadcast({}) };
+					intersect(ray, hit);
+					Mask hitMask = hit.t < Floats(rayTMax);
+
+					// Same encoding as the GPU, miss is black
+					Vec3s color{ select(hitMask, hit.normal.x * 0.5f + 0.5f, 0.0f),
+						select(hitMask, hit.normal.y * 0.5f + 0.5f, 0.0f),
+						select(hitMask, hit.normal.z * 0.5f + 0.5f, 0.0f) };
+					float rgb[3][Floats::width];
+					color.x.store(rgb[0]);
+					color.y.store(rgb[1]);
+					color.z.store(rgb[2]);
+					for (int lane = 0; lane < Floats::width; lane++) {
+						if (!inside[lane]) {
+							continue;
+						}
+						uint32_t x = px * packetWidth + lane % packetWidth;
+						uint32_t y = static_cast<uint32_t>(py) * 2 + lane / packetWidth;
+						uint8_t* pixel = pixels.data() + (static_cast<size_t>(y) * width + x) * 3;
+						for (int c = 0; c < 3; c++) {
+							pixel[c] = static_cast<uint8_t>(std::lround(std::clamp(rgb[c][lane], 0.0f, 1.0f) * 255.0f));
+						}
+					}
+				}
+			});
+
+			auto end = std::chrono::steady_clock::now();
+			std::cout << "Reference image rendered in "
+				<< std::chrono::duration<double, std::milli>(end - start).count() << " ms\n";
+			return pixels;
+		}
+
+		// Closest hits of a world space packet, lanes keep hit.t where nothing is closer
+		void intersect(const RayPacket& ray, HitPacket& hit) const {
+			if (topLevel.nodes.empty() || instances.empty()) {
+				return;
+			}
+			traverse(topLevel, ray, hit.t, [&](uint32_t first, uint32_t count, Mask) {
+				for (uint32_t i = first; i < first + count; i++) {
+					intersectInstance(instances[i], ray, hit);
+				}
+			});
+		}
+
+	private:
+		struct Triangle {
+			Vec3 v0, edge1, edge2;
+		};
+
+		struct MeshBvh {
+			Bvh bvh;
+			std::vector<Triangle> triangles;  // in BVH leaf order
+		};
+
+		struct Instance {
+			uint32_t mesh = 0;
+			Transform worldToObject = identityTransform;
+		};
+
+		static Vec3 transformPoint(const Transform& m, Vec3 p) {
+			return { m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+				m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+				m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3] };
+		}
+
+		// Inverse of an affine 3x4 transform
+		static Transform invert(const Transform& m) {
+			float a = m[0][0], b = m[0][1], c = m[0][2];
+			float d = m[1][0], e = m[1][1], f = m[1][2];
+			float g = m[2][0], h = m[2][1], k = m[2][2];
+			float det = a * (e * k - f * h) - b * (d * k - f * g) + c * (d * h - e * g);
+			float s = det != 0.0f ? 1.0f / det : 0.0f;
+
+			Transform r{};
+			r[0] = { (e * k - f * h) * s, (c * h - b * k) * s, (b * f - c * e) * s, 0.0f };
+			r[1] = { (f * g - d * k) * s, (a * k - c * g) * s, (c * d - a * f) * s, 0.0f };
+			r[2] = { (d * h - e * g) * s, (b * g - a * h) * s, (a * e - b * d) * s, 0.0f };
+			for (int row = 0; row < 3; row++) {
+				r[row][3] = -(r[row][0] * m[0][3] + r[row][1] * m[1][3] + r[row][2] * m[2][3]);
+			}
+			return r;
+		}
+
+		// Walks `bvh` front to back for the packet and calls leaf(first, count,
+		// lanes) for every leaf that any active lane reaches
+		template <typename Leaf>
+		static void traverse(const Bvh& bvh, const RayPacket& ray, const Floats& tMax, Leaf&& leaf) {
+			uint32_t stack[64];
+			uint32_t stackSize = 0;
+			stack[stackSize++] = 0;
+
+			// Children are visited in the order the packet's first lane meets them
+			float firstDirection[3][Floats::width];
+			ray.direction.x.store(firstDirection[0]);
+			ray.direction.y.store(firstDirection[1]);
+			ray.direction.z.store(firstDirection[2]);
+			uint32_t activeBits = ray.active.bits();
+			int firstLane = 0;
+			while (firstLane < Floats::width - 1 && !(activeBits & (1u << firstLane))) {
+				firstLane++;
+			}
+
+			while (stackSize > 0) {
+				const Bvh::Node& node = bvh.nodes[stack[--stackSize]];
+				Mask lanes = intersectBox(ray, tMax, node.bounds);
+				if (!lanes.any()) {
+					continue;
+				}
+				if (node.count > 0) {
+					leaf(node.first, node.count, lanes);
+					continue;
+				}
+				bool negative = firstDirection[node.axis][firstLane] < 0.0f;
+				stack[stackSize++] = node.first + (negative ? 0 : 1);
+				stack[stackSize++] = node.first + (negative ? 1 : 0);
+			}
+		}
+
+		void intersectInstance(const Instance& instance, const RayPacket& worldRay, HitPacket& hit) const {
+			// Object space packet. Directions are not renormalized, so t stays
+			// the world space distance.
+			const Transform& m = instance.worldToObject;
+			const Vec3s& o = worldRay.origin;
+			const Vec3s& d = worldRay.direction;
+			RayPacket ray;
+			ray.origin = {
+				o.x * m[0][0] + o.y * m[0][1] + o.z * m[0][2] + m[0][3],
+				o.x * m[1][0] + o.y * m[1][1] + o.z * m[1][2] + m[1][3],
+				o.x * m[2][0] + o.y * m[2][1] + o.z * m[2][2] + m[2][3] };
+			ray.direction = {
+				d.x * m[0][0] + d.y * m[0][1] + d.z * m[0][2],
+				d.x * m[1][0] + d.y * m[1][1] + d.z * m[1][2],
+				d.x * m[2][0] + d.y * m[2][1] + d.z * m[2][2] };
+			ray.inverseDirection = { safeReciprocal(ray.direction.x),
+				safeReciprocal(ray.direction.y), safeReciprocal(ray.direction.z) };
+			ray.active = worldRay.active;
+
+			const MeshBvh& mesh = meshes[instance.mesh];
+			traverse(mesh.bvh, ray, hit.t, [&](uint32_t first, uint32_t count, Mask lanes) {
+				for (uint32_t i = first; i < first + count; i++) {
+					const Triangle& triangle = mesh.triangles[i];
+
+					// Moller-Trumbore, both faces like gl_RayFlagsOpaqueEXT
+					// with TriangleFacingCullDisable
+					Vec3s e1 = broadcast(triangle.edge1);
+					Vec3s e2 = broadcast(triangle.edge2);
+					Vec3s p = cross(ray.direction, e2);
+					Floats det = dot(e1, p);
+					Floats inverseDet = Floats(1.0f) / det;
+					Vec3s s = ray.origin - broadcast(triangle.v0);
+					Floats u = dot(s, p) * inverseDet;
+					Vec3s q = cross(s, e1);
+					Floats v = dot(ray.direction, q) * inverseDet;
+					Floats t = dot(e2, q) * inverseDet;
+
+					Mask accepted = lanes & (abs(det) > Floats(1e-12f)) &
+						(u >= Floats(0.0f)) & (v >= Floats(0.0f)) & (u + v <= Floats(1.0f)) &
+						(t > Floats(rayTMin)) & (t < hit.t);
+					if (!accepted.any()) {
+						continue;
+					}
+
+					// Geometric normal as in closesthit.rchit: object space
+					// cross product times gl_WorldToObjectEXT, facing the ray
+					Vec3 n = cross(triangle.edge1, triangle.edge2);
+					Vec3 world = normalize({ n.x * m[0][0] + n.y * m[1][0] + n.z * m[2][0],
+						n.x * m[0][1] + n.y * m[1][1] + n.z * m[2][1],
+						n.x * m[0][2] + n.y * m[1][2] + n.z * m[2][2] });
+					Vec3s normal = broadcast(world);
+					Mask facing = dot(normal, worldRay.direction) > Floats(0.0f);
+					Floats sign = select(facing, Floats(-1.0f), Floats(1.0f));
+
+					hit.t = select(accepted, t, hit.t);
+					hit.normal.x = select(accepted, normal.x * sign, hit.normal.x);
+					hit.normal.y = select(accepted, normal.y * sign, hit.normal.y);
+					hit.normal.z = select(accepted, normal.z * sign, hit.normal.z);
+				}
+			});
+		}
+
+		std::vector<MeshBvh> meshes;
+		std::vector<Instance> instances;  // in TLAS leaf order
+		Bvh topLevel;
+	};
+
+	inline void writePpm(const std::string& filename, uint32_t width, uint32_t height,
+		const std::vector<uint8_t>& pixels) {
+		std::ofstream file(filename, std::ios::binary);
+		if (!file.is_open()) {
+			std::cerr << "Failed to open output file: " << filename << "\n";
+			std::abort();
+		}
+		file << "P6\n" << width << " " << height << "\n255\n";
+		file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+	}
+
+	// Reads a binary PPM as written by writePpm() and saveOffscreenImage()
+	inline std::vector<uint8_t> readPpm(const std::string& filename, uint32_t& width, uint32_t& height) {
+		std::ifstream file(filename, std::ios::binary);
+		std::string magic;
+		uint32_t maxValue = 0;
+		file >> magic >> width >> height >> maxValue;
+		if (!file || magic != "P6" || maxValue != 255) {
+			std::cerr << "Failed to read PPM image: " << filename << "\n";
+			std::abort();
+		}
+		file.get();  // single whitespace before the pixel data
+
+		std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+		file.read(reinterpret_cast<char*>(pixels.data()), pixels.size());
+		if (!file) {
+			std::cerr << "Truncated PPM image: " << filename << "\n";
+			std::abort();
+		}
+		return pixels;
+	}
+
+	struct ImageDiff {
+		size_t differentPixels = 0;  // any channel off by more than the tolerance
+		uint32_t maxDifference = 0;
+		double meanDifference = 0.0;
+		std::vector<uint8_t> image;  // per pixel maximum channel difference, grey RGB8
+	};
+
+	inline ImageDiff diffImages(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b,
+		uint32_t tolerance) {
+		ImageDiff diff;
+		size_t pixelCount = std::min(a.size(), b.size()) / 3;
+		diff.image.resize(pixelCount * 3);
+		uint64_t sum = 0;
+		for (size_t i = 0; i < pixelCount; i++) {
+			uint32_t pixelDifference = 0;
+			for (int c = 0; c < 3; c++) {
+				uint32_t d = static_cast<uint32_t>(std::abs(int(a[i * 3 + c]) - int(b[i * 3 + c])));
+				pixelDifference = std::max(pixelDifference, d);
+				sum += d;
+			}
+			if (pixelDifference > tolerance) {
+				diff.differentPixels++;
+			}
+			diff.maxDifference = std::max(diff.maxDifference, pixelDifference);
+			std::fill_n(diff.image.begin() + i * 3, 3, static_cast<uint8_t>(pixelDifference));
+		}
+		diff.meanDifference = pixelCount > 0 ? static_cast<double>(sum) / (pixelCount * 3) : 0.0;
+		return diff;
+	}
+}  // namespace reference
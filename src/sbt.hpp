@@ -0,0 +1,177 @@
+#pragma once
+#include <array>
+#include "staging.hpp"
+
+// Shader binding table in device-local memory. Every record is a shader
+// group handle followed by optional inline data that the shader reads
+// through shaderRecordEXT; records of a region share the stride of its
+// largest record. Regions can be re-uploaded on their own when only their
+// data changed.
+class ShaderBindingTable {
+public:
+	enum Region : uint32_t {
+		regionRaygen,
+		regionMiss,
+		regionHit,
+		regionCallable,
+		regionCount,
+	};
+
+	void init(vk::PhysicalDevice physicalDevice, vk::Device device) {
+		this->device = device;
+		vk::PhysicalDeviceRayTracingPipelinePropertiesKHR rtProperties =
+			vkutils::getRayTracingProps(physicalDevice);
+		handleSize = rtProperties.shaderGroupHandleSize;
+		handleAlignment = rtProperties.shaderGroupHandleAlignment;
+		baseAlignment = rtProperties.shaderGroupBaseAlignment;
+		maxStride = rtProperties.maxShaderGroupStride;
+	}
+
+	// Appends a record of shader group `group` and returns its index in the
+	// region. Hit records are selected by instance SBT offset + ray type.
+	uint32_t addRecord(Region region, uint32_t group,
+		const void* data = nullptr, size_t dataSize = 0) {
+		std::vector<Record>& records = regions[region].records;
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		records.push_back({ group, std::vector<uint8_t>(bytes, bytes + dataSize) });
+		return static_cast<uint32_t>(records.size()) - 1;
+	}
+
+	// Replaces the inline data of a record; takes effect on updateRegion()
+	void setRecordData(Region region, uint32_t index, const void* data, size_t dataSize) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		regions[region].records[index].data.assign(bytes, bytes + dataSize);
+	}
+
+	// Lays out all regions and queues the upload on the staging ring
+	void build(MemoryAllocator& allocator, StagingRing& stagingRing, vk::Pipeline pipeline) {
+		std::cout << "Create shader binding table\n";
+
+		uint32_t groupCount = 0;
+		for (const RegionData& region : regions) {
+			for (const Record& record : region.records) {
+				groupCount = std::max(groupCount, record.group + 1);
+			}
+		}
+		handles.resize(static_cast<size_t>(groupCount) * handleSize);
+		auto result = device.getRayTracingShaderGroupHandlesKHR(
+			pipeline, 0, groupCount, handles.size(), handles.data());
+		if (result != vk::Result::eSuccess) {
+			std::cerr << "Failed to get ray tracing shader group handles.\n";
+			std::abort();
+		}
+
+		vk::DeviceSize tableSize = 0;
+		for (uint32_t r = 0; r < regionCount; r++) {
+			RegionData& region = regions[r];
+			size_t maxDataSize = 0;
+			for (const Record& record : region.records) {
+				maxDataSize = std::max(maxDataSize, record.data.size());
+			}
+
+			region.stride = vkutils::alignUp(static_cast<vk::DeviceSize>(handleSize + maxDataSize),
+				static_cast<vk::DeviceSize>(handleAlignment));
+			if (r == regionRaygen) {
+				// The raygen region's size must equal its stride
+				region.stride = vkutils::alignUp(region.stride, static_cast<vk::DeviceSize>(baseAlignment));
+			}
+			if (region.stride > maxStride) {
+				std::cerr << "Shader record of " << region.stride << " bytes exceeds maxShaderGroupStride\n";
+				std::abort();
+			}
+			region.offset = vkutils::alignUp(tableSize, static_cast<vk::DeviceSize>(baseAlignment));
+			tableSize = region.offset + region.stride * region.records.size();
+		}
+
+		hostData.assign(tableSize, 0);
+		for (uint32_t r = 0; r < regionCount; r++) {
+			writeRecords(static_cast<Region>(r));
+		}
+
+		// Region start addresses must be aligned to shaderGroupBaseAlignment,
+		// which can exceed the buffer's own alignment
+		buffer.init(allocator, device, std::max<vk::DeviceSize>(tableSize, 1) + baseAlignment,
+			vk::BufferUsageFlagBits::eShaderBindingTableKHR |
+			vk::BufferUsageFlagBits::eShaderDeviceAddress |
+			vk::BufferUsageFlagBits::eTransferDst,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+		bufferOffset = vkutils::alignUp(buffer.address, static_cast<vk::DeviceSize>(baseAlignment)) - buffer.address;
+		stagingRing.upload(*buffer.buffer, bufferOffset, hostData.data(), hostData.size());
+
+		for (RegionData& region : regions) {
+			vk::DeviceSize size = region.stride * region.records.size();
+			region.addressRegion = size > 0
+				? vk::StridedDeviceAddressRegionKHR{ buffer.address + bufferOffset + region.offset, region.stride, size }
+				: vk::StridedDeviceAddressRegionKHR{};
+		}
+		this->pipeline = pipeline;
+	}
+
+	// Re-uploads one region after setRecordData(). Frames recorded earlier
+	// may still read the table, the staging ring orders the copy after them.
+	// Records that outgrew the stride or were added force a full rebuild
+	// into a new buffer. The replaced buffer is returned, empty otherwise;
+	// the caller keeps it until the frames in flight have completed.
+	[[nodiscard]] Buffer updateRegion(MemoryAllocator& allocator, StagingRing& stagingRing, Region region) {
+		RegionData& data = regions[region];
+		bool fits = data.records.size() * data.stride == data.addressRegion.size;
+		for (const Record& record : data.records) {
+			fits = fits && handleSize + record.data.size() <= data.stride;
+		}
+		if (!fits) {
+			Buffer replaced = std::move(buffer);
+			build(allocator, stagingRing, pipeline);
+			return replaced;
+		}
+
+		writeRecords(region);
+		if (!data.records.empty()) {
+			stagingRing.upload(*buffer.buffer, bufferOffset + data.offset,
+				hostData.data() + data.offset, data.stride * data.records.size());
+		}
+		return {};
+	}
+
+	const vk::StridedDeviceAddressRegionKHR& getRegion(Region region) const {
+		return regions[region].addressRegion;
+	}
+
+private:
+	struct Record {
+		uint32_t group;
+		std::vector<uint8_t> data;
+	};
+
+	struct RegionData {
+		std::vector<Record> records;
+		vk::DeviceSize offset = 0;
+		vk::DeviceSize stride = 0;
+		vk::StridedDeviceAddressRegionKHR addressRegion{};
+	};
+
+	void writeRecords(Region region) {
+		RegionData& data = regions[region];
+		for (size_t i = 0; i < data.records.size(); i++) {
+			const Record& record = data.records[i];
+			uint8_t* dst = hostData.data() + data.offset + data.stride * i;
+			std::memcpy(dst, handles.data() + static_cast<size_t>(record.group) * handleSize, handleSize);
+			std::memset(dst + handleSize, 0, data.stride - handleSize);
+			if (!record.data.empty()) {
+				std::memcpy(dst + handleSize, record.data.data(), record.data.size());
+			}
+		}
+	}
+
+	vk::Device device;
+	vk::Pipeline pipeline;
+	uint32_t handleSize = 0;
+	uint32_t handleAlignment = 0;
+	uint32_t baseAlignment = 0;
+	uint32_t maxStride = 0;
+
+	std::array<RegionData, regionCount> regions;
+	std::vector<uint8_t> handles;
+	std::vector<uint8_t> hostData;  // copy of the whole table, patched per region
+	Buffer buffer;
+	vk::DeviceSize bufferOffset = 0;
+};
@@ -0,0 +1,193 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <mutex>
+#include "vkutils.hpp"
+
+// Completion of a submission: the point at which its timeline semaphore
+// reaches `value`. Tickets are plain values and may be waited on from any
+// queue or scheduler.
+struct GpuTicket {
+	vk::Semaphore semaphore;
+	uint64_t value = 0;
+
+	bool isValid() const { return semaphore && value > 0; }
+
+	// Makes another submission wait for this one before `stage`
+	vkutils::TimelineWait asWait(vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eAllCommands) const {
+		return { semaphore, value, stage };
+	}
+};
+
+// Asynchronous submissions to one queue. Every submit() records into a
+// pooled command buffer, signals the scheduler's timeline semaphore and
+// returns right away; the caller only blocks in wait() when it needs the
+// result. Command buffers are reused once their value has been reached.
+// Callbacks added with then() run on the thread calling update(), poll()
+// or wait() after their ticket completed, e.g. to free scratch memory.
+// All methods may be called from any thread.
+class GpuScheduler {
+public:
+	using RecordFunction = std::function<void(vk::CommandBuffer)>;
+
+	void init(vk::Device device, uint32_t queueFamilyIndex, vk::Queue queue) {
+		std::cout << "Create GPU scheduler: queue family " << queueFamilyIndex << "\n";
+
+		this->device = device;
+		this->queue = queue;
+		commandPool = vkutils::createCommandPool(device, queueFamilyIndex);
+		timeline = vkutils::createTimelineSemaphore(device);
+	}
+
+	GpuTicket submit(const RecordFunction& func, const std::vector<vkutils::TimelineWait>& waits = {}) {
+		std::lock_guard<std::mutex> lock(mutex);
+		retireCompleted();
+
+		vk::CommandBuffer commandBuffer = acquire();
+		vk::CommandBufferBeginInfo beginInfo{};
+		beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		commandBuffer.begin(beginInfo);
+		func(commandBuffer);
+		commandBuffer.end();
+
+		std::vector<vk::Semaphore> waitSemaphores;
+		std::vector<uint64_t> waitValues;
+		std::vector<vk::PipelineStageFlags> waitStages;
+		for (const auto& wait : waits) {
+			if (wait.semaphore && wait.value > 0) {
+				waitSemaphores.push_back(wait.semaphore);
+				waitValues.push_back(wait.value);
+				waitStages.push_back(wait.stage);
+			}
+		}
+
+		// Values are taken and submitted under the lock so they signal in order
+		uint64_t signalValue = ++submittedValue;
+		vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.setWaitSemaphoreValues(waitValues);
+		timelineInfo.setSignalSemaphoreValues(signalValue);
+
+		vk::SubmitInfo submitInfo{};
+		submitInfo.setCommandBuffers(commandBuffer);
+		submitInfo.setWaitSemaphores(waitSemaphores);
+		submitInfo.setWaitDstStageMask(waitStages);
+		submitInfo.setSignalSemaphores(*timeline);
+		submitInfo.setPNext(&timelineInfo);
+		vkutils::submitToQueue(queue, submitInfo);
+
+		inFlight.push_back({ commandBuffer, signalValue });
+		return { *timeline, signalValue };
+	}
+
+	// Runs `callback` once `ticket` has completed; right away if it already has
+	void then(const GpuTicket& ticket, std::function<void()> callback) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			callbacks.push_back({ ticket, std::move(callback) });
+		}
+		update();
+	}
+
+	bool poll(const GpuTicket& ticket) {
+		bool complete = isComplete(ticket);
+		if (complete) {
+			update();
+		}
+		return complete;
+	}
+
+	void wait(const GpuTicket& ticket) {
+		if (ticket.isValid()) {
+			vk::SemaphoreWaitInfo waitInfo{ {}, ticket.semaphore, ticket.value };
+			if (device.waitSemaphores(waitInfo, UINT64_MAX) != vk::Result::eSuccess) {
+				std::cerr << "Failed to wait for GPU ticket\n";
+				std::abort();
+			}
+		}
+		update();
+	}
+
+	// Waits for everything submitted so far
+	void waitIdle() { wait(getLastTicket()); }
+
+	// Recycles finished command buffers and runs callbacks whose ticket completed
+	void update() {
+		std::vector<std::function<void()>> ready;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			retireCompleted();
+			for (size_t i = 0; i < callbacks.size();) {
+				if (isComplete(callbacks[i].ticket)) {
+					ready.push_back(std::move(callbacks[i].callback));
+					callbacks.erase(callbacks.begin() + i);
+				}
+				else {
+					i++;
+				}
+			}
+		}
+		// Outside the lock, callbacks may submit again
+		for (auto& callback : ready) {
+			callback();
+		}
+	}
+
+	// The latest submission, e.g. for a frame to wait on
+	GpuTicket getLastTicket() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return { *timeline, submittedValue };
+	}
+
+	vk::Queue getQueue() const { return queue; }
+
+private:
+	struct InFlight {
+		vk::CommandBuffer commandBuffer;
+		uint64_t value = 0;
+	};
+
+	struct Callback {
+		GpuTicket ticket;
+		std::function<void()> callback;
+	};
+
+	bool isComplete(const GpuTicket& ticket) const {
+		return !ticket.isValid() || device.getSemaphoreCounterValue(ticket.semaphore) >= ticket.value;
+	}
+
+	vk::CommandBuffer acquire() {
+		if (!freeCommandBuffers.empty()) {
+			vk::CommandBuffer commandBuffer = freeCommandBuffers.back();
+			freeCommandBuffers.pop_back();
+			commandBuffer.reset();
+			return commandBuffer;
+		}
+		vk::CommandBufferAllocateInfo allocateInfo{};
+		allocateInfo.setCommandPool(*commandPool);
+		allocateInfo.setLevel(vk::CommandBufferLevel::ePrimary);
+		allocateInfo.setCommandBufferCount(1);
+		return device.allocateCommandBuffers(allocateInfo).front();  // freed with the pool
+	}
+
+	void retireCompleted() {
+		if (inFlight.empty()) {
+			return;
+		}
+		uint64_t completedValue = device.getSemaphoreCounterValue(*timeline);
+		while (!inFlight.empty() && inFlight.front().value <= completedValue) {
+			freeCommandBuffers.push_back(inFlight.front().commandBuffer);
+			inFlight.pop_front();
+		}
+	}
+
+	vk::Device device;
+	vk::Queue queue;
+	vk::UniqueCommandPool commandPool;
+	vk::UniqueSemaphore timeline;
+	uint64_t submittedValue = 0;
+
+	std::mutex mutex;
+	std::deque<InFlight> inFlight;
+	std::vector<vk::CommandBuffer> freeCommandBuffers;
+	std::vector<Callback> callbacks;
+};
@@ -1,6 +1,6 @@
 @echo off
 set GLSLANG_VALIDATOR=%VULKAN_SDK%/Bin/glslangValidator.exe
 
-for %%s in (raygen.rgen closesthit.rchit miss.rmiss) do (
+for %%s in (raygen.rgen closesthit.rchit miss.rmiss shadow.rmiss) do (
     %GLSLANG_VALIDATOR% %%s -V -o %%s.spv --target-env vulkan1.2
 )
\ No newline at end of file
@@ -0,0 +1,13 @@
+// Hit record returned to the bounce loop in raygen.rgen. The closest hit and
+// miss shaders only describe the surface; all sampling happens in raygen so
+// the pipeline never recurses.
+struct Payload {
+    vec3 emission;       // emitted radiance, the sky on a miss
+    float hitT;          // < 0 on a miss
+    vec3 position;       // world space hit point
+    float roughness;
+    vec3 normal;         // shading normal, facing the incoming ray
+    float metallic;
+    vec3 geometricNormal;
+    vec3 albedo;
+};
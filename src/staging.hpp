@@ -0,0 +1,344 @@
+#pragma once
+#include <deque>
+#include "memory.hpp"
+
+// Persistently mapped ring buffer for uploads into device-local buffers and
+// sampled images. Uploads are copied into the ring and batched into one
+// submission per flush; ring space is reclaimed when the batch's timeline
+// value is reached.
+//
+// The ring may run on its own queue, e.g. a dedicated transfer queue, while
+// the data is used on an owner queue. Its batches then wait for the owner's
+// work submitted so far (setOwnerTimeline), uploaded images are released to
+// the owner family and acquired on the owner queue, and the owner waits for
+// getTimeline() at getSubmittedValue() before it reads uploaded data.
+class StagingRing {
+public:
+	void init(MemoryAllocator& allocator, vk::Device device,
+		uint32_t queueFamilyIndex, vk::Queue queue,
+		vk::DeviceSize size = 64ull << 20) {
+		init(allocator, device, queueFamilyIndex, queue, queueFamilyIndex, queue, size);
+	}
+
+	void init(MemoryAllocator& allocator, vk::Device device,
+		uint32_t queueFamilyIndex, vk::Queue queue,
+		uint32_t ownerFamilyIndex, vk::Queue ownerQueue,
+		vk::DeviceSize size = 64ull << 20) {
+		std::cout << "Create staging ring\n";
+
+		this->device = device;
+		this->queue = queue;
+		this->size = size;
+		this->queueFamilyIndex = queueFamilyIndex;
+		this->ownerFamilyIndex = ownerFamilyIndex;
+		this->ownerQueue = ownerQueue;
+		commandPool = vkutils::createCommandPool(device, queueFamilyIndex);
+		timeline = vkutils::createTimelineSemaphore(device);
+		if (ownerFamilyIndex != queueFamilyIndex) {
+			ownerCommandPool = vkutils::createCommandPool(device, ownerFamilyIndex);
+			acquireTimeline = vkutils::createTimelineSemaphore(device);
+		}
+		ringBuffer.init(allocator, device, size,
+			vk::BufferUsageFlagBits::eTransferSrc,
+			vk::MemoryPropertyFlagBits::eHostVisible |
+			vk::MemoryPropertyFlagBits::eHostCoherent);
+		mapped = static_cast<char*>(ringBuffer.allocation.mapped());
+	}
+
+	// Creates a device-local buffer and queues its initial contents
+	Buffer createBuffer(MemoryAllocator& allocator, vk::DeviceSize size,
+		vk::BufferUsageFlags usage, const void* data) {
+		Buffer buffer;
+		buffer.init(allocator, device, size,
+			usage | vk::BufferUsageFlagBits::eTransferDst,
+			vk::MemoryPropertyFlagBits::eDeviceLocal);
+		upload(*buffer.buffer, 0, data, size);
+		return buffer;
+	}
+
+	// Queues a copy of data into dstBuffer. The data is consumed before
+	// returning; the copy happens on the next flush.
+	void upload(vk::Buffer dstBuffer, vk::DeviceSize dstOffset,
+		const void* data, vk::DeviceSize dataSize) {
+		const char* src = static_cast<const char*>(data);
+		while (dataSize > 0) {
+			vk::DeviceSize chunk = std::min(dataSize, size);
+			vk::DeviceSize offset = reserve(chunk);
+			memcpy(mapped + offset, src, chunk);
+			pendingCopies.push_back({ dstBuffer, vk::BufferCopy{ offset, dstOffset, chunk } });
+
+			src += chunk;
+			dstOffset += chunk;
+			dataSize -= chunk;
+		}
+	}
+
+	// Queues tightly packed texels for the whole of a single-mip image, in
+	// chunks of whole rows. The image ends up in shader read-only layout.
+	void uploadImage(vk::Image dstImage, vk::Extent2D extent,
+		const void* data, vk::DeviceSize texelSize) {
+		vk::DeviceSize rowSize = extent.width * texelSize;
+		if (rowSize > size) {
+			std::cerr << "Image row does not fit into the staging ring\n";
+			std::abort();
+		}
+
+		pendingImages.push_back({ dstImage });
+		const char* src = static_cast<const char*>(data);
+		uint32_t rowsPerChunk = static_cast<uint32_t>(std::min<vk::DeviceSize>(size / rowSize, extent.height));
+		for (uint32_t row = 0; row < extent.height; row += rowsPerChunk) {
+			uint32_t rows = std::min(rowsPerChunk, extent.height - row);
+			vk::DeviceSize offset = reserve(rows * rowSize);
+			memcpy(mapped + offset, src + row * rowSize, rows * rowSize);
+
+			vk::BufferImageCopy region{};
+			region.setBufferOffset(offset);
+			region.setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0, 0, 1 });
+			region.setImageOffset({ 0, static_cast<int32_t>(row), 0 });
+			region.setImageExtent({ extent.width, rows, 1 });
+			pendingImageCopies.push_back({ dstImage, region });
+		}
+		pendingImages.back().complete = true;
+	}
+
+	// Batches on a queue other than the owner's first wait until `semaphore`
+	// reaches *submittedValue, so in-place updates such as a shader binding
+	// table region never overwrite data that earlier owner work still reads
+	void setOwnerTimeline(vk::Semaphore semaphore, const uint64_t* submittedValue) {
+		ownerTimeline = semaphore;
+		ownerSubmittedValue = submittedValue;
+	}
+
+	// The owner queue waits for this before it reads uploaded data
+	vk::Semaphore getTimeline() const { return *timeline; }
+	uint64_t getSubmittedValue() const { return submittedValue; }
+	vkutils::TimelineWait getWait() const { return { *timeline, submittedValue }; }
+
+	// Submits all queued copies. Later submissions to the same queue see
+	// the data through the barrier at the end of the batch.
+	void flush() {
+		if (pendingCopies.empty() && pendingImageCopies.empty()) {
+			return;
+		}
+
+		Batch batch{};
+		batch.commandBuffer = vkutils::createCommandBuffer(device, *commandPool);
+		batch.commandBuffer->begin(vk::CommandBufferBeginInfo{
+			vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+		// Earlier submissions may still read a range that is overwritten,
+		// e.g. a shader binding table region being updated. Owner work on
+		// another queue is waited for through its timeline instead.
+		batch.commandBuffer->pipelineBarrier(
+			vk::PipelineStageFlagBits::eAllCommands,
+			vk::PipelineStageFlagBits::eTransfer,
+			{}, nullptr, nullptr, nullptr);
+		for (const auto& [dstBuffer, region] : pendingCopies) {
+			batch.commandBuffer->copyBuffer(*ringBuffer.buffer, dstBuffer, region);
+		}
+
+		// An image split across batches keeps its transfer layout in between
+		for (const auto& pending : pendingImages) {
+			vkutils::setImageLayout(*batch.commandBuffer, pending.image,
+				pending.started ? vk::ImageLayout::eTransferDstOptimal : vk::ImageLayout::eUndefined,
+				vk::ImageLayout::eTransferDstOptimal);
+		}
+		for (const auto& [dstImage, region] : pendingImageCopies) {
+			batch.commandBuffer->copyBufferToImage(*ringBuffer.buffer, dstImage,
+				vk::ImageLayout::eTransferDstOptimal, region);
+		}
+		// Finished images move to shader read-only layout. For another
+		// family the same barrier releases them here and acquires them on
+		// the owner queue.
+		std::vector<vk::ImageMemoryBarrier> acquireBarriers;
+		for (auto& pending : pendingImages) {
+			if (pending.complete && ownerFamilyIndex == queueFamilyIndex) {
+				vkutils::setImageLayout(*batch.commandBuffer, pending.image,
+					vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+			}
+			else if (pending.complete) {
+				vk::ImageMemoryBarrier release{};
+				release.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+				release.setOldLayout(vk::ImageLayout::eTransferDstOptimal);
+				release.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+				release.setSrcQueueFamilyIndex(queueFamilyIndex);
+				release.setDstQueueFamilyIndex(ownerFamilyIndex);
+				release.setImage(pending.image);
+				release.setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+				batch.commandBuffer->pipelineBarrier(
+					vk::PipelineStageFlagBits::eTransfer,
+					vk::PipelineStageFlagBits::eBottomOfPipe,
+					{}, {}, {}, release);
+
+				vk::ImageMemoryBarrier acquire = release;
+				acquire.setSrcAccessMask({});
+				acquire.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+				acquireBarriers.push_back(acquire);
+			}
+			pending.started = true;
+		}
+
+		vk::MemoryBarrier barrier{};
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+		barrier.setDstAccessMask(vk::AccessFlagBits::eMemoryRead);
+		batch.commandBuffer->pipelineBarrier(
+			vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eAllCommands,
+			{}, barrier, {}, {});
+		batch.commandBuffer->end();
+
+		std::vector<vkutils::TimelineWait> waits;
+		if (ownerQueue != queue && ownerTimeline && ownerSubmittedValue) {
+			waits.push_back({ ownerTimeline, *ownerSubmittedValue, vk::PipelineStageFlagBits::eTransfer });
+		}
+		batch.value = ++submittedValue;
+		submit(queue, *batch.commandBuffer, waits, *timeline, batch.value);
+
+		if (!acquireBarriers.empty()) {
+			batch.acquireCommandBuffer = vkutils::createCommandBuffer(device, *ownerCommandPool);
+			batch.acquireCommandBuffer->begin(vk::CommandBufferBeginInfo{
+				vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+			batch.acquireCommandBuffer->pipelineBarrier(
+				vk::PipelineStageFlagBits::eTopOfPipe,
+				vk::PipelineStageFlagBits::eAllCommands,
+				{}, {}, {}, acquireBarriers);
+			batch.acquireCommandBuffer->end();
+
+			// Its own timeline, the owner queue may run it after later batches
+			batch.acquireValue = ++acquireSubmittedValue;
+			submit(ownerQueue, *batch.acquireCommandBuffer,
+				{ { *timeline, batch.value, vk::PipelineStageFlagBits::eAllCommands } },
+				*acquireTimeline, batch.acquireValue);
+		}
+		batch.end = head;
+
+		batches.push_back(std::move(batch));
+		pendingCopies.clear();
+		pendingImageCopies.clear();
+		std::erase_if(pendingImages, [](const PendingImage& pending) { return pending.complete; });
+	}
+
+	// Flushes and waits until every upload has reached its buffer
+	void finish() {
+		flush();
+		while (!batches.empty()) {
+			retireOldest();
+		}
+	}
+
+private:
+	struct Batch {
+		vk::UniqueCommandBuffer commandBuffer;
+		vk::UniqueCommandBuffer acquireCommandBuffer;  // on the owner queue
+		uint64_t value = 0;         // timeline value once the copies are done
+		uint64_t acquireValue = 0;  // acquireTimeline value, 0 without images to acquire
+		uint64_t end = 0;
+	};
+
+	static void submit(vk::Queue target, vk::CommandBuffer commandBuffer,
+		const std::vector<vkutils::TimelineWait>& waits,
+		vk::Semaphore signalSemaphore, uint64_t signalValue) {
+		std::vector<vk::Semaphore> waitSemaphores;
+		std::vector<uint64_t> waitValues;
+		std::vector<vk::PipelineStageFlags> waitStages;
+		for (const auto& wait : waits) {
+			waitSemaphores.push_back(wait.semaphore);
+			waitValues.push_back(wait.value);
+			waitStages.push_back(wait.stage);
+		}
+
+		vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.setWaitSemaphoreValues(waitValues);
+		timelineInfo.setSignalSemaphoreValues(signalValue);
+
+		vk::SubmitInfo submitInfo{};
+		submitInfo.setCommandBuffers(commandBuffer);
+		submitInfo.setWaitSemaphores(waitSemaphores);
+		submitInfo.setWaitDstStageMask(waitStages);
+		submitInfo.setSignalSemaphores(signalSemaphore);
+		submitInfo.setPNext(&timelineInfo);
+		vkutils::submitToQueue(target, submitInfo);
+	}
+
+	bool isComplete(const Batch& batch) const {
+		return device.getSemaphoreCounterValue(*timeline) >= batch.value &&
+			(batch.acquireValue == 0 || device.getSemaphoreCounterValue(*acquireTimeline) >= batch.acquireValue);
+	}
+
+	struct PendingImage {
+		vk::Image image;
+		bool started = false;   // an earlier batch moved it to transfer layout
+		bool complete = false;  // all of its rows are queued
+	};
+
+	// Returns the ring offset of a contiguous range. Positions grow
+	// monotonically; head - tail is the space still owned by batches.
+	vk::DeviceSize reserve(vk::DeviceSize chunk) {
+		while (!batches.empty() && isComplete(batches.front())) {
+			retireOldest();
+		}
+
+		while (true) {
+			uint64_t start = vkutils::alignUp(head, static_cast<uint64_t>(16));
+			if (start % size + chunk > size) {
+				// Skip the tail end of the ring instead of splitting the range
+				start += size - start % size;
+			}
+			if (start + chunk - tail <= size) {
+				head = start + chunk;
+				return start % size;
+			}
+
+			if (!pendingCopies.empty() || !pendingImageCopies.empty()) {
+				flush();
+			}
+			if (batches.empty()) {
+				head = tail = 0;
+				continue;
+			}
+			retireOldest();
+		}
+	}
+
+	void retireOldest() {
+		Batch& batch = batches.front();
+		std::vector<vk::Semaphore> semaphores{ *timeline };
+		std::vector<uint64_t> values{ batch.value };
+		if (batch.acquireValue > 0) {
+			semaphores.push_back(*acquireTimeline);
+			values.push_back(batch.acquireValue);
+		}
+		if (device.waitSemaphores(vk::SemaphoreWaitInfo{ {}, semaphores, values }, UINT64_MAX) != vk::Result::eSuccess) {
+			std::cerr << "Failed to wait for staging upload\n";
+			std::abort();
+		}
+		tail = batch.end;
+		batches.pop_front();
+	}
+
+	vk::Device device;
+	vk::Queue queue;
+	vk::UniqueCommandPool commandPool;
+	uint32_t queueFamilyIndex = 0;
+	vk::UniqueSemaphore timeline;
+	uint64_t submittedValue = 0;
+
+	// Queue that reads the uploads
+	uint32_t ownerFamilyIndex = 0;
+	vk::Queue ownerQueue;
+	vk::UniqueCommandPool ownerCommandPool;
+	vk::UniqueSemaphore acquireTimeline;
+	uint64_t acquireSubmittedValue = 0;
+	vk::Semaphore ownerTimeline;
+	const uint64_t* ownerSubmittedValue = nullptr;
+	Buffer ringBuffer;
+	char* mapped = nullptr;
+	vk::DeviceSize size = 0;
+
+	uint64_t head = 0;
+	uint64_t tail = 0;
+	std::vector<std::pair<vk::Buffer, vk::BufferCopy>> pendingCopies;
+	std::vector<std::pair<vk::Image, vk::BufferImageCopy>> pendingImageCopies;
+	std::vector<PendingImage> pendingImages;
+	std::deque<Batch> batches;
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <chrono>
+#include <iomanip>
+#include <string>
+#include "jobs.hpp"
+
+// Dependency graph of startup stages run on the job system. A stage starts
+// as soon as every stage it depends on has finished, so file I/O, parsing,
+// pipeline compilation and GPU setup overlap. Each stage's start and end
+// time is recorded for printTimeline().
+class StartupGraph {
+public:
+	using StageId = uint32_t;
+
+	// Dependencies must already have been added, which rules out cycles
+	StageId add(std::string name, std::function<void()> function,
+		const std::vector<StageId>& dependencies = {}) {
+		StageId id = static_cast<StageId>(stages.size());
+		auto stage = std::make_unique<Stage>();
+		stage->name = std::move(name);
+		stage->function = std::move(function);
+		stage->dependencyCount = static_cast<uint32_t>(dependencies.size());
+		for (StageId dependency : dependencies) {
+			if (dependency >= id) {
+				std::cerr << "Startup stage " << stage->name << " depends on a later stage\n";
+				std::abort();
+			}
+			stages[dependency]->dependents.push_back(id);
+		}
+		stages.push_back(std::move(stage));
+		return id;
+	}
+
+	// Runs every stage and returns once all have finished. The calling
+	// thread helps, so this also works without worker threads.
+	void run(JobSystem& jobs) {
+		startTime = std::chrono::steady_clock::now();
+		for (auto& stage : stages) {
+			stage->remaining.store(stage->dependencyCount, std::memory_order_relaxed);
+		}
+
+		JobSystem::Group group;
+		for (StageId id = 0; id < stages.size(); id++) {
+			if (stages[id]->dependencyCount == 0) {
+				launch(jobs, group, id);
+			}
+		}
+		jobs.wait(group);
+		totalTime = elapsed();
+	}
+
+	// One line per stage in start order: start and end relative to run(),
+	// duration and the job system thread it ran on
+	void printTimeline() const {
+		std::vector<const Stage*> sorted;
+		size_t nameWidth = 0;
+		for (const auto& stage : stages) {
+			sorted.push_back(stage.get());
+			nameWidth = std::max(nameWidth, stage->name.size());
+		}
+		std::sort(sorted.begin(), sorted.end(),
+			[](const Stage* a, const Stage* b) { return a->start < b->start; });
+
+		std::cout << "Startup timeline (" << std::fixed << std::setprecision(1) << totalTime << " ms):\n";
+		for (const Stage* stage : sorted) {
+			std::cout << "  " << std::left << std::setw(static_cast<int>(nameWidth)) << stage->name << std::right
+				<< std::setw(9) << stage->start << " -> " << std::setw(7) << stage->end << " ms"
+				<< std::setw(9) << stage->end - stage->start << " ms  thread " << stage->thread << "\n";
+		}
+		std::cout << std::defaultfloat << std::setprecision(6);
+	}
+
+private:
+	struct Stage {
+		std::string name;
+		std::function<void()> function;
+		std::vector<StageId> dependents;
+		uint32_t dependencyCount = 0;
+		std::atomic<uint32_t> remaining{ 0 };
+
+		// Written by the thread running the stage, read after run()
+		double start = 0.0;
+		double end = 0.0;
+		uint32_t thread = 0;
+	};
+
+	void launch(JobSystem& jobs, JobSystem::Group& group, StageId id) {
+		jobs.run(group, [this, &jobs, &group, id]() {
+			Stage& stage = *stages[id];
+			stage.thread = JobSystem::getThreadIndex();
+			stage.start = elapsed();
+			stage.function();
+			stage.end = elapsed();
+
+			// The last dependency to finish starts the dependent; acq_rel
+			// makes every dependency's results visible to it
+			for (StageId dependent : stage.dependents) {
+				if (stages[dependent]->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					launch(jobs, group, dependent);
+				}
+			}
+		});
+	}
+
+	double elapsed() const {
+		return std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - startTime).count();
+	}
+
+	std::vector<std::unique_ptr<Stage>> stages;
+	std::chrono::steady_clock::time_point startTime;
+	double totalTime = 0.0;
+};
@@ -2,12 +2,17 @@
 #define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 #include <limits>
 
@@ -46,14 +51,17 @@ namespace vkutils {
         return true;
     }
 
-    inline std::vector<const char*> getRequiredExtensions() {
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions =
-            glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-        std::vector<const char*> extensions(glfwExtensions,
-            glfwExtensions + glfwExtensionCount);
-        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+    inline std::vector<const char*> getRequiredExtensions(bool headless, bool debugUtils) {
+        std::vector<const char*> extensions;
+        if (!headless) {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions =
+                glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
+        if (debugUtils) {
+            extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        }
         return extensions;
     }
 
@@ -72,7 +80,8 @@ namespace vkutils {
 
     inline vk::UniqueInstance createInstance(
         uint32_t apiVersion,
-        const std::vector<const char*>& layers) {
+        const std::vector<const char*>& layers,
+        bool headless = false) {
         std::cout << "Create instance\n";
 
         // Setup dynamic loader
@@ -91,7 +100,9 @@ namespace vkutils {
         vk::ApplicationInfo appInfo{};
         appInfo.setApiVersion(apiVersion);
 
-        std::vector<const char*> extensions = getRequiredExtensions();
+        // Debug utils are only needed to report messages of validation layers
+        bool debugUtils = !layers.empty();
+        std::vector<const char*> extensions = getRequiredExtensions(headless, debugUtils);
 
         vk::DebugUtilsMessengerCreateInfoEXT debugCreateInfo =
             createDebugCreateInfo();
@@ -100,7 +111,9 @@ namespace vkutils {
         instanceCreateInfo.setPApplicationInfo(&appInfo);
         instanceCreateInfo.setPEnabledLayerNames(layers);
         instanceCreateInfo.setPEnabledExtensionNames(extensions);
-        instanceCreateInfo.setPNext(&debugCreateInfo);
+        if (debugUtils) {
+            instanceCreateInfo.setPNext(&debugCreateInfo);
+        }
         vk::UniqueInstance instance = vk::createInstanceUnique(instanceCreateInfo);
         VULKAN_HPP_DEFAULT_DISPATCHER.init(*instance);
         return instance;
@@ -125,11 +138,12 @@ namespace vkutils {
         return vk::UniqueSurfaceKHR{ vk::SurfaceKHR(_surface), {instance} };
     }
 
+    // Without a surface (headless) present support is not required
     inline uint32_t findGeneralQueueFamily(vk::PhysicalDevice physicalDevice,
         vk::SurfaceKHR surface) {
         auto queueFamilies = physicalDevice.getQueueFamilyProperties();
         for (uint32_t i = 0; i < queueFamilies.size(); i++) {
-            vk::Bool32 presentSupport =
+            vk::Bool32 presentSupport = !surface ||
                 physicalDevice.getSurfaceSupportKHR(i, surface);
             if (queueFamilies[i].queueFlags & vk::QueueFlagBits::eGraphics &&
                 presentSupport) {
@@ -140,6 +154,57 @@ namespace vkutils {
         std::abort();
     }
 
+    // Queue families used by the renderer. compute and transfer fall back to
+    // the general family when the device has no dedicated one.
+    struct QueueFamilies {
+        uint32_t general = 0;   // graphics, compute and present
+        uint32_t compute = 0;   // async compute without graphics
+        uint32_t transfer = 0;  // copies only
+
+        // Families to create one queue of, without duplicates
+        std::vector<uint32_t> unique() const {
+            std::vector<uint32_t> families{ general };
+            for (uint32_t family : { compute, transfer }) {
+                if (std::find(families.begin(), families.end(), family) == families.end()) {
+                    families.push_back(family);
+                }
+            }
+            return families;
+        }
+    };
+
+    inline QueueFamilies findQueueFamilies(vk::PhysicalDevice physicalDevice,
+        vk::SurfaceKHR surface) {
+        QueueFamilies families;
+        families.general = findGeneralQueueFamily(physicalDevice, surface);
+        families.compute = families.general;
+        families.transfer = families.general;
+
+        auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+        for (uint32_t i = 0; i < queueFamilies.size(); i++) {
+            vk::QueueFlags flags = queueFamilies[i].queueFlags;
+            if ((flags & vk::QueueFlagBits::eCompute) && !(flags & vk::QueueFlagBits::eGraphics)) {
+                families.compute = i;
+                break;
+            }
+        }
+
+        // Uploads copy images in chunks of rows, which a coarser transfer
+        // granularity does not allow; compute queues can copy as well
+        families.transfer = families.compute;
+        for (uint32_t i = 0; i < queueFamilies.size(); i++) {
+            vk::QueueFlags flags = queueFamilies[i].queueFlags;
+            vk::Extent3D granularity = queueFamilies[i].minImageTransferGranularity;
+            if ((flags & vk::QueueFlagBits::eTransfer) &&
+                !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)) &&
+                granularity == vk::Extent3D{ 1, 1, 1 }) {
+                families.transfer = i;
+                break;
+            }
+        }
+        return families;
+    }
+
     inline bool checkDeviceExtensionSupport(
         vk::PhysicalDevice device,
         const std::vector<const char*>& deviceExtensions) {
@@ -157,6 +222,9 @@ namespace vkutils {
         if (!checkDeviceExtensionSupport(physicalDevice, deviceExtensions)) {
             return false;
         }
+        if (!surface) {
+            return true;
+        }
         if (physicalDevice.getSurfaceFormatsKHR(surface).empty() ||
             physicalDevice.getSurfacePresentModesKHR(surface).empty()) {
             return false;
@@ -187,18 +255,29 @@ namespace vkutils {
             .get<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
     }
 
+    inline auto getAccelStructProps(vk::PhysicalDevice physicalDevice) {
+        auto deviceProperties = physicalDevice.getProperties2<
+            vk::PhysicalDeviceProperties2,
+            vk::PhysicalDeviceAccelerationStructurePropertiesKHR>();
+        return deviceProperties
+            .get<vk::PhysicalDeviceAccelerationStructurePropertiesKHR>();
+    }
+
+    // Creates one queue of each family
     inline vk::UniqueDevice createLogicalDevice(
         vk::PhysicalDevice physicalDevice,
-        uint32_t queueFamilyIndex,
+        const std::vector<uint32_t>& queueFamilyIndices,
         const std::vector<const char*>& deviceExtensions) {
         std::cout << "Create device\n";
 
         float queuePriority = 1.0f;
-        vk::DeviceQueueCreateInfo queueCreateInfo{
-            {}, queueFamilyIndex, 1, &queuePriority };
+        std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
+        for (uint32_t queueFamilyIndex : queueFamilyIndices) {
+            queueCreateInfos.push_back({ {}, queueFamilyIndex, 1, &queuePriority });
+        }
 
         vk::DeviceCreateInfo deviceCreateInfo{};
-        deviceCreateInfo.setQueueCreateInfos(queueCreateInfo);
+        deviceCreateInfo.setQueueCreateInfos(queueCreateInfos);
         deviceCreateInfo.setPEnabledExtensionNames(deviceExtensions);
 
         vk::StructureChain createInfoChain{
@@ -206,6 +285,11 @@ namespace vkutils {
             vk::PhysicalDeviceRayTracingPipelineFeaturesKHR{VK_TRUE},
             vk::PhysicalDeviceAccelerationStructureFeaturesKHR{VK_TRUE},
             vk::PhysicalDeviceBufferDeviceAddressFeatures{VK_TRUE},
+            vk::PhysicalDeviceDescriptorIndexingFeatures{}
+                .setShaderSampledImageArrayNonUniformIndexing(VK_TRUE)
+                .setDescriptorBindingPartiallyBound(VK_TRUE)
+                .setRuntimeDescriptorArray(VK_TRUE),
+            vk::PhysicalDeviceTimelineSemaphoreFeatures{VK_TRUE},
         };
 
         vk::UniqueDevice device = physicalDevice.createDeviceUnique(
@@ -214,6 +298,40 @@ namespace vkutils {
         return device;
     }
 
+    inline vk::UniqueDevice createLogicalDevice(
+        vk::PhysicalDevice physicalDevice,
+        uint32_t queueFamilyIndex,
+        const std::vector<const char*>& deviceExtensions) {
+        return createLogicalDevice(physicalDevice,
+            std::vector<uint32_t>{ queueFamilyIndex }, deviceExtensions);
+    }
+
+    inline vk::UniqueSemaphore createTimelineSemaphore(vk::Device device,
+        uint64_t initialValue = 0) {
+        vk::StructureChain createInfoChain{
+            vk::SemaphoreCreateInfo{},
+            vk::SemaphoreTypeCreateInfo{ vk::SemaphoreType::eTimeline, initialValue },
+        };
+        return device.createSemaphoreUnique(createInfoChain.get<vk::SemaphoreCreateInfo>());
+    }
+
+    // A submission waits until `semaphore` reaches `value` before `stage`
+    struct TimelineWait {
+        vk::Semaphore semaphore;
+        uint64_t value = 0;
+        vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eAllCommands;
+    };
+
+    // vkQueueSubmit must be externally synchronized per queue. Startup stages
+    // on several threads may share a queue, e.g. on a device with a single
+    // queue family, so every submission goes through one lock.
+    inline void submitToQueue(vk::Queue queue, const vk::SubmitInfo& submitInfo,
+        vk::Fence fence = {}) {
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.submit(submitInfo, fence);
+    }
+
     inline vk::SurfaceFormatKHR chooseSurfaceFormat(
         vk::PhysicalDevice physicalDevice,
         vk::SurfaceKHR surface) {
@@ -265,7 +383,7 @@ namespace vkutils {
         vk::SurfaceFormatKHR surfaceFormat,
         uint32_t width,
         uint32_t height,
-        vk::Extent2D swapchainExtent) {
+        vk::Extent2D& swapchainExtent) {
         std::cout << "Create swapchain\n";
 
         vk::SurfaceCapabilitiesKHR capabilities =
@@ -324,37 +442,6 @@ namespace vkutils {
         return device.createCommandPoolUnique(commandPoolCreateInfo);
     }
 
-    inline void oneTimeSubmit(vk::Device device,
-        vk::CommandPool commandPool,
-        vk::Queue queue,
-        const std::function<void(vk::CommandBuffer)>& func) {
-        // Allocate
-        vk::CommandBufferAllocateInfo allocateInfo{};
-        allocateInfo.setCommandPool(commandPool);
-        allocateInfo.setLevel(vk::CommandBufferLevel::ePrimary);
-        allocateInfo.setCommandBufferCount(1);
-        auto commandBuffers = device.allocateCommandBuffersUnique(allocateInfo);
-
-        // Record
-        commandBuffers[0]->begin(vk::CommandBufferBeginInfo{});
-        func(commandBuffers[0].get());
-        commandBuffers[0]->end();
-
-        // Submit
-        vk::UniqueFence fence = device.createFenceUnique({});
-        vk::SubmitInfo submitInfo{};
-        submitInfo.setCommandBuffers(commandBuffers[0].get());
-        queue.submit(submitInfo, fence.get());
-
-        // Wait
-        if (device.waitForFences(fence.get(), true,
-            std::numeric_limits<uint64_t>::max()) !=
-            vk::Result::eSuccess) {
-            std::cerr << "Failed to wait for fence.\n";
-            std::abort();
-        }
-    }
-
     inline vk::UniqueCommandBuffer createCommandBuffer(
         vk::Device device,
         vk::CommandPool commandPool) {
@@ -389,6 +476,141 @@ namespace vkutils {
         return device.createShaderModuleUnique(createInfo);
     }
 
+    // Runs func(i) for i in [0, count) on the caller's threads, the calling
+    // one included, e.g. JobSystem::parallelFor
+    using ParallelFor = std::function<void(size_t, const std::function<void(size_t)>&)>;
+
+    // Works on a deferred operation from as many threads of parallelFor as
+    // the driver can use, then returns the operation's result
+    inline vk::Result joinDeferredOperation(vk::Device device,
+        vk::DeferredOperationKHR operation, const ParallelFor& parallelFor) {
+        uint32_t threadCount = std::min(
+            device.getDeferredOperationMaxConcurrencyKHR(operation),
+            std::max(std::thread::hardware_concurrency(), 1u));
+
+        auto join = [&]() {
+            while (true) {
+                vk::Result result = device.deferredOperationJoinKHR(operation);
+                if (result != vk::Result::eThreadIdleKHR) {
+                    return;  // done, or no more work for this thread
+                }
+                std::this_thread::yield();
+            }
+        };
+
+        // Joins that start after the operation finished return at once
+        parallelFor(threadCount, [&](size_t) { join(); });
+        return device.getDeferredOperationResultKHR(operation);
+    }
+
+    // Creates a ray tracing pipeline as a deferred host operation. The
+    // driver writes the handle when the operation completes, so it goes
+    // through the C entry point with storage that outlives the join.
+    // Returns a null handle on failure.
+    inline vk::UniquePipeline createRayTracingPipelineDeferred(vk::Device device,
+        vk::PipelineCache pipelineCache,
+        const vk::RayTracingPipelineCreateInfoKHR& createInfo, const ParallelFor& parallelFor) {
+        vk::UniqueDeferredOperationKHR operation = device.createDeferredOperationKHRUnique();
+
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        auto result = static_cast<vk::Result>(
+            VULKAN_HPP_DEFAULT_DISPATCHER.vkCreateRayTracingPipelinesKHR(
+                device, *operation, pipelineCache, 1,
+                reinterpret_cast<const VkRayTracingPipelineCreateInfoKHR*>(&createInfo),
+                nullptr, &pipeline));
+        if (result == vk::Result::eOperationDeferredKHR) {
+            result = joinDeferredOperation(device, *operation, parallelFor);
+        }
+        else if (result == vk::Result::eOperationNotDeferredKHR) {
+            result = vk::Result::eSuccess;
+        }
+
+        if (result != vk::Result::eSuccess || pipeline == VK_NULL_HANDLE) {
+            std::cerr << "Failed to create ray tracing pipeline: " << vk::to_string(result) << "\n";
+            return {};
+        }
+        return vk::UniquePipeline(vk::Pipeline(pipeline),
+            vk::ObjectDestroy<vk::Device, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE>(
+                device, nullptr, VULKAN_HPP_DEFAULT_DISPATCHER));
+    }
+
+    // Checks the header the driver writes in front of pipeline cache data
+    // (VkPipelineCacheHeaderVersionOne). Data from another device or
+    // driver build is discarded rather than handed to the driver.
+    inline bool isPipelineCacheCompatible(vk::PhysicalDevice physicalDevice,
+        const std::vector<char>& data) {
+        constexpr size_t headerSize = 16 + VK_UUID_SIZE;
+        if (data.size() < headerSize) {
+            return false;
+        }
+
+        uint32_t header[4];
+        memcpy(header, data.data(), sizeof(header));
+
+        vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+        return header[0] >= headerSize &&
+            header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+            header[2] == properties.vendorID &&
+            header[3] == properties.deviceID &&
+            memcmp(data.data() + 16, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+    }
+
+    inline vk::UniquePipelineCache loadPipelineCache(vk::Device device,
+        vk::PhysicalDevice physicalDevice,
+        const std::string& filename) {
+        std::vector<char> data;
+        std::ifstream file(filename, std::ios::ate | std::ios::binary);
+        if (file.is_open()) {
+            data.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(data.data(), data.size());
+        }
+
+        vk::PipelineCacheCreateInfo createInfo{};
+        if (isPipelineCacheCompatible(physicalDevice, data)) {
+            std::cout << "Load pipeline cache: " << filename << " (" << data.size() << " bytes)\n";
+            createInfo.setInitialDataSize(data.size());
+            createInfo.setPInitialData(data.data());
+        }
+        else if (!data.empty()) {
+            std::cout << "Discard incompatible pipeline cache: " << filename << "\n";
+        }
+        return device.createPipelineCacheUnique(createInfo);
+    }
+
+    // Writes to a temporary file first and renames it over the cache, which
+    // replaces the target atomically, so an interrupted save leaves either
+    // the old or the new cache behind
+    inline void savePipelineCache(vk::Device device,
+        vk::PipelineCache pipelineCache,
+        const std::string& filename) {
+        std::vector<uint8_t> data = device.getPipelineCacheData(pipelineCache);
+
+        std::string tempFilename = filename + ".tmp";
+        {
+            std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                std::cerr << "Failed to save pipeline cache: " << filename << "\n";
+                return;
+            }
+            file.write(reinterpret_cast<const char*>(data.data()), data.size());
+            file.close();
+            if (!file) {
+                std::cerr << "Failed to write pipeline cache: " << tempFilename << "\n";
+                std::remove(tempFilename.c_str());
+                return;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(tempFilename, filename, error);
+        if (error) {
+            std::cerr << "Failed to replace pipeline cache " << filename << ": " << error.message() << "\n";
+            std::remove(tempFilename.c_str());
+            return;
+        }
+        std::cout << "Save pipeline cache: " << filename << " (" << data.size() << " bytes)\n";
+    }
+
     inline void setImageLayout(vk::CommandBuffer commandBuffer,
         vk::Image image,
         vk::ImageLayout oldImageLayout,
@@ -434,6 +656,9 @@ namespace vkutils {
         case vk::ImageLayout::eShaderReadOnlyOptimal:
             imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
             break;
+        case vk::ImageLayout::eGeneral:
+            imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+            break;
         default:
             break;
         }
@@ -465,6 +690,11 @@ namespace vkutils {
             }
             imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
             break;
+        case vk::ImageLayout::eGeneral:
+            imageMemoryBarrier.dstAccessMask =
+                vk::AccessFlagBits::eShaderRead |
+                vk::AccessFlagBits::eShaderWrite;
+            break;
         default:
             break;
         }
@@ -477,4 +707,8 @@ namespace vkutils {
     inline uint32_t alignUp(uint32_t size, uint32_t alignment) {
         return (size + alignment - 1) & ~(alignment - 1);
     }
+
+    inline vk::DeviceSize alignUp(vk::DeviceSize size, vk::DeviceSize alignment) {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
 }  // namespace vkutils
\ No newline at end of file